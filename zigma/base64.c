@@ -28,21 +28,208 @@
 #include "base64.h"
 #include "zigma.h"
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BASE64_X86
+#include <immintrin.h>
+#endif
+
 static const char base64_chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 
+/* The kernels in use, or -1 before the first call. */
+static int base64_kernel = -1;
+
+base64_kernel_t base64_select(base64_kernel_t limit)
+{
+  base64_kernel_t best = BASE64_SCALAR;
+
+#ifdef BASE64_X86
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports("sse4.1"))
+    best = BASE64_SSE41;
+
+  if (__builtin_cpu_supports("avx2"))
+    best = BASE64_AVX2;
+#endif
+
+  base64_kernel = limit < best ? limit : best;
+
+  return base64_kernel;
+}
+
+#ifdef BASE64_X86
+/*
+ * Vector kernels after Wojciech Mula and Daniel Lemire, "Faster Base64
+ * Encoding and Decoding Using AVX2 Instructions". Each one handles whole
+ * blocks only and returns how much input it consumed; the scalar code does
+ * the rest. The decoders stop in front of the first block holding anything
+ * but the 64 alphabet characters, so the scalar code also reports errors.
+ */
+
+/* The tables are per 16-byte lane, repeated in both lanes for AVX2. */
+#define BASE64_SPREAD   10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1
+#define BASE64_OFFSETS                                                                                          \
+  'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, \
+      '+' - 62, '/' - 63, 'A', 0, 0
+#define BASE64_VALID_LO 0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A
+#define BASE64_VALID_HI 0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10
+#define BASE64_ROLL     0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0
+#define BASE64_JOIN     2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1
+
+__attribute__((target("sse4.1"))) static unsigned long base64_encode_sse41(char*                data,
+                                                                            unsigned char const* buffer,
+                                                                            unsigned long        length)
+{
+  unsigned long i = 0;
+
+  for (; i + 16 <= length; i += 12, data += 16) {
+    __m128i in = _mm_loadu_si128((__m128i const*) (buffer + i));
+
+    /* Spread 12 bytes into 16 sextets, one per byte. */
+    in = _mm_shuffle_epi8(in, _mm_set_epi8(BASE64_SPREAD));
+
+    __m128i ac = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+    __m128i bd = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+
+    in = _mm_or_si128(ac, bd);
+
+    /* Map each range of sextets to its characters by adding an offset. */
+    __m128i range = _mm_subs_epu8(in, _mm_set1_epi8(51));
+    __m128i upper = _mm_cmpgt_epi8(_mm_set1_epi8(26), in);
+
+    range = _mm_or_si128(range, _mm_and_si128(upper, _mm_set1_epi8(13)));
+    in    = _mm_add_epi8(in, _mm_shuffle_epi8(_mm_setr_epi8(BASE64_OFFSETS), range));
+
+    _mm_storeu_si128((__m128i*) data, in);
+  }
+
+  return i;
+}
+
+__attribute__((target("sse4.1"))) static unsigned long base64_decode_sse41(char*         data,
+                                                                            char const*   buffer,
+                                                                            unsigned long length)
+{
+  unsigned long i = 0;
+
+  /* Keep clear of the padding and of the end of the output. */
+  for (; i + 24 <= length; i += 16, data += 12) {
+    __m128i in = _mm_loadu_si128((__m128i const*) (buffer + i));
+    __m128i hi = _mm_and_si128(_mm_srli_epi32(in, 4), _mm_set1_epi8(0x0f));
+    __m128i lo = _mm_and_si128(in, _mm_set1_epi8(0x0f));
+
+    /* A character is valid when its nibbles share no bit in the tables. */
+    if (!_mm_testz_si128(_mm_shuffle_epi8(_mm_setr_epi8(BASE64_VALID_LO), lo),
+                         _mm_shuffle_epi8(_mm_setr_epi8(BASE64_VALID_HI), hi)))
+      break;
+
+    __m128i slash = _mm_cmpeq_epi8(in, _mm_set1_epi8('/'));
+
+    in = _mm_add_epi8(in, _mm_shuffle_epi8(_mm_setr_epi8(BASE64_ROLL), _mm_add_epi8(slash, hi)));
+
+    /* Pack 16 sextets into 12 bytes. */
+    in = _mm_maddubs_epi16(in, _mm_set1_epi32(0x01400140));
+    in = _mm_madd_epi16(in, _mm_set1_epi32(0x00011000));
+    in = _mm_shuffle_epi8(in, _mm_setr_epi8(BASE64_JOIN));
+
+    _mm_storeu_si128((__m128i*) data, in);
+  }
+
+  return i;
+}
+
+__attribute__((target("avx2"))) static unsigned long base64_encode_avx2(char*                data,
+                                                                         unsigned char const* buffer,
+                                                                         unsigned long        length)
+{
+  unsigned long i = 0;
+
+  for (; i + 28 <= length; i += 24, data += 32) {
+    __m256i in = _mm256_loadu2_m128i((__m128i const*) (buffer + i + 12), (__m128i const*) (buffer + i));
+
+    in = _mm256_shuffle_epi8(in, _mm256_set_epi8(BASE64_SPREAD, BASE64_SPREAD));
+
+    __m256i ac = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+    __m256i bd = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+
+    ac = _mm256_mulhi_epu16(ac, _mm256_set1_epi32(0x04000040));
+    bd = _mm256_mullo_epi16(bd, _mm256_set1_epi32(0x01000010));
+
+    in = _mm256_or_si256(ac, bd);
+
+    __m256i range = _mm256_subs_epu8(in, _mm256_set1_epi8(51));
+    __m256i upper = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), in);
+
+    range = _mm256_or_si256(range, _mm256_and_si256(upper, _mm256_set1_epi8(13)));
+    in    = _mm256_add_epi8(in, _mm256_shuffle_epi8(_mm256_setr_epi8(BASE64_OFFSETS, BASE64_OFFSETS), range));
+
+    _mm256_storeu_si256((__m256i*) data, in);
+  }
+
+  return i;
+}
+
+__attribute__((target("avx2"))) static unsigned long base64_decode_avx2(char*         data,
+                                                                         char const*   buffer,
+                                                                         unsigned long length)
+{
+  unsigned long i = 0;
+
+  for (; i + 48 <= length; i += 32, data += 24) {
+    __m256i in = _mm256_loadu_si256((__m256i const*) (buffer + i));
+    __m256i hi = _mm256_and_si256(_mm256_srli_epi32(in, 4), _mm256_set1_epi8(0x0f));
+    __m256i lo = _mm256_and_si256(in, _mm256_set1_epi8(0x0f));
+
+    if (!_mm256_testz_si256(_mm256_shuffle_epi8(_mm256_setr_epi8(BASE64_VALID_LO, BASE64_VALID_LO), lo),
+                            _mm256_shuffle_epi8(_mm256_setr_epi8(BASE64_VALID_HI, BASE64_VALID_HI), hi)))
+      break;
+
+    __m256i slash = _mm256_cmpeq_epi8(in, _mm256_set1_epi8('/'));
+    __m256i roll  = _mm256_shuffle_epi8(_mm256_setr_epi8(BASE64_ROLL, BASE64_ROLL), _mm256_add_epi8(slash, hi));
+
+    in = _mm256_add_epi8(in, roll);
+    in = _mm256_maddubs_epi16(in, _mm256_set1_epi32(0x01400140));
+    in = _mm256_madd_epi16(in, _mm256_set1_epi32(0x00011000));
+    in = _mm256_shuffle_epi8(in, _mm256_setr_epi8(BASE64_JOIN, BASE64_JOIN));
+
+    /* Close the gap between the 12 bytes of each lane. */
+    in = _mm256_permutevar8x32_epi32(in, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+
+    _mm256_storeu_si256((__m256i*) data, in);
+  }
+
+  return i;
+}
+#endif /* BASE64_X86 */
+
 /* Encode a buffer to base64.
  *  @param data The output buffer, or NULL to allocate one.
  *  @param buffer The input buffer.
  *  @param length The length of the input buffer.
  *  @return The length of the output buffer.
  */
-unsigned int base64_encode(char* data, char const* buffer, unsigned long length)
+unsigned long base64_encode(char* data, char const* buffer, unsigned long length)
 {
   unsigned long output_length = 4 * ((length + 2) / 3);
+  unsigned long i             = 0;
+  unsigned long j             = 0;
 
   DEBUG_ASSERT(data != NULL);
 
-  for (int i = 0, j = 0; i < length;) {
+  if (base64_kernel < 0)
+    base64_select(BASE64_AVX2);
+
+#ifdef BASE64_X86
+  if (base64_kernel >= BASE64_AVX2)
+    i += base64_encode_avx2(data, (unsigned char const*) buffer, length);
+
+  if (base64_kernel >= BASE64_SSE41)
+    i += base64_encode_sse41(data + i / 3 * 4, (unsigned char const*) buffer + i, length - i);
+
+  j = i / 3 * 4;
+#endif
+
+  while (i < length) {
     unsigned long octet_a = i < length ? (unsigned char) buffer[i++] : 0;
     unsigned long octet_b = i < length ? (unsigned char) buffer[i++] : 0;
     unsigned long octet_c = i < length ? (unsigned char) buffer[i++] : 0;
@@ -91,7 +278,7 @@ unsigned char base64_char_value(char c)
  *  @param length The length of the input buffer.
  *  @return The length of the output buffer.
  */
-unsigned int base64_sanitize(char* output, char const* input, unsigned long length)
+unsigned long base64_sanitize(char* output, char const* input, unsigned long length)
 {
   DEBUG_ASSERT(input != NULL);
 
@@ -103,7 +290,7 @@ unsigned int base64_sanitize(char* output, char const* input, unsigned long leng
 
   DEBUG_ASSERT(output != NULL);
 
-  unsigned int output_length = 0;
+  unsigned long output_length = 0;
   bool         in_comment    = false;
 
   for (unsigned long i = 0; i < length; i++) {
@@ -128,36 +315,53 @@ unsigned int base64_sanitize(char* output, char const* input, unsigned long leng
   return output_length;
 }
 
-/* Decode a base64 buffer.
+/* Decode a base64 buffer. Padding may only end the last quartet.
  *  @param data The output buffer, or NULL to allocate one.
  *  @param buffer The input buffer.
  *  @param length The length of the input buffer.
- *  @return The length of the output buffer.
+ *  @return The length of the output buffer, or 0 if the input is malformed.
  */
-unsigned int base64_decode(char* data, char const* buffer, unsigned long length)
+unsigned long base64_decode(char* data, char const* buffer, unsigned long length)
 {
-  if (length % 4 != 0)
+  if (length == 0 || length % 4 != 0)
     return 0;
 
-  unsigned int output_length = length / 4 * 3;
-
-  if (buffer[length - 1] == '=')
-    output_length--;
-  if (buffer[length - 2] == '=')
-    output_length--;
+  unsigned long padding       = buffer[length - 1] != '=' ? 0 : buffer[length - 2] != '=' ? 1 : 2;
+  unsigned long output_length = length / 4 * 3 - padding;
 
   if (data == NULL)
     data = malloc(output_length);
 
   DEBUG_ASSERT(data != NULL);
 
-  for (unsigned long i = 0, j = 0; i < length;) {
-    unsigned long sextet_a = buffer[i] == '=' ? 0 & i++ : base64_char_value(data[i++]);
-    unsigned long sextet_b = buffer[i] == '=' ? 0 & i++ : base64_char_value(data[i++]);
-    unsigned long sextet_c = buffer[i] == '=' ? 0 & i++ : base64_char_value(data[i++]);
-    unsigned long sextet_d = buffer[i] == '=' ? 0 & i++ : base64_char_value(data[i++]);
+  unsigned long i = 0;
+  unsigned long j = 0;
+
+  if (base64_kernel < 0)
+    base64_select(BASE64_AVX2);
+
+#ifdef BASE64_X86
+  if (base64_kernel >= BASE64_AVX2)
+    i += base64_decode_avx2(data, buffer, length);
+
+  if (base64_kernel >= BASE64_SSE41)
+    i += base64_decode_sse41(data + i / 4 * 3, buffer + i, length - i);
+
+  j = i / 4 * 3;
+#endif
 
-    unsigned long triple = (sextet_a << 3 * 6) + (sextet_b << 2 * 6) + (sextet_c << 1 * 6) + (sextet_d << 0 * 6);
+  for (; i < length; i += 4) {
+    unsigned int  digits = i + 4 < length ? 4 : 4 - padding;
+    unsigned long triple = 0;
+
+    for (unsigned int k = 0; k < 4; k++) {
+      unsigned char sextet = k < digits ? base64_char_value(buffer[i + k]) : 0;
+
+      if (sextet > 63)
+        return 0;
+
+      triple = triple << 6 | sextet;
+    }
 
     if (j < output_length)
       data[j++] = (triple >> 2 * 8) & 0xFF;
@@ -24,8 +24,19 @@
 #ifndef _ZIGMA_BASE64_H_
 #define _ZIGMA_BASE64_H_
 
-unsigned int base64_encode(char* data, char const* buffer, unsigned long length);
-unsigned int base64_decode(char* data, char const* buffer, unsigned long length);
-unsigned int base64_sanitize(char* output, char const* input, unsigned long length);
+/* Instruction sets the codec can use, in order of preference. */
+typedef enum { BASE64_SCALAR = 0, BASE64_SSE41, BASE64_AVX2 } base64_kernel_t;
+
+/* Selects the best kernels the processor supports, up to a limit. The
+ * selection is made automatically on first use; every kernel produces the
+ * same bytes, so this only matters for testing and benchmarks.
+ *   @param limit The most capable kernel allowed.
+ *   @return The kernel now in use.
+ */
+base64_kernel_t base64_select(base64_kernel_t limit);
+
+unsigned long base64_encode(char* data, char const* buffer, unsigned long length);
+unsigned long base64_decode(char* data, char const* buffer, unsigned long length);
+unsigned long base64_sanitize(char* output, char const* input, unsigned long length);
 
 #endif /* _ZIGMA_BASE64_H_ */
\ No newline at end of file
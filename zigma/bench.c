@@ -0,0 +1,353 @@
+/*
+ * ZIGMA, Copyright (C) 1999, 2005, 2023 Chase Zehl O'Byrne
+ *  <mail: zehl@live.com> http://zehlchen.com/
+ *
+ * This file is part of ZIGMA.
+ *
+ * ZIGMA is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ZIGMA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ZIGMA; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/* Times the cipher and its building blocks over a sweep of buffer sizes and
+ * writes the results as JSON, one measurement per line, for comparing builds.
+ *
+ *   $ zigma_bench [of=FILE] [max=BYTES] [time=MS]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_TSC 1
+#else
+#define BENCH_TSC 0
+#endif
+
+#include "base64.h"
+#include "matrix.h"
+#include "zigma.h"
+
+/* Smallest buffer of the sweep; every step is four times the last. */
+#define BENCH_MIN 16
+
+/* An operation on a buffer of the given size. */
+typedef void(bench_op_t)(uint64 size);
+
+typedef struct bench_t {
+  FILE*  fp;
+  int    records;
+  uint64 max;
+  uint64 min_time;
+} bench_t;
+
+/* Buffers shared by the operations, max bytes each (the codec's 4/3 more). */
+static uint8*   bench_input;
+static uint8*   bench_output;
+static char*    bench_encoded;
+static zigma_t* bench_key;
+static zigma_t  bench_state;
+static uint8    bench_passkey[256];
+
+static uint64 bench_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64 bench_ticks(void)
+{
+#if BENCH_TSC
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+static void bench_init(uint64 size)
+{
+  zigma_init(&bench_state, bench_passkey, size);
+}
+
+static void bench_keyrand(uint64 size)
+{
+  uint8  rsum   = 0;
+  uint32 keypos = 0;
+
+  for (int i = 255; i >= 0; i--)
+    zigma_keyrand(&bench_state, i, bench_passkey, size, &rsum, &keypos);
+}
+
+static void bench_encrypt_byte(uint64 size)
+{
+  for (uint64 i = 0; i < size; i++)
+    bench_output[i] = zigma_encrypt_byte(&bench_state, bench_input[i]);
+}
+
+static void bench_encrypt(uint64 size)
+{
+  zigma_encrypt(&bench_state, bench_input, size);
+}
+
+static void bench_decrypt(uint64 size)
+{
+  zigma_decrypt(&bench_state, bench_input, size);
+}
+
+/* Independent messages of size bytes each, ZIGMA_MULTI_MAX of them, either
+ * all of the same length or alternately a quarter and seven quarters of it.
+ */
+static zigma_t  bench_lanes[ZIGMA_MULTI_MAX];
+static zigma_t* bench_handles[ZIGMA_MULTI_MAX];
+static uint8*   bench_messages[ZIGMA_MULTI_MAX];
+static uint32   bench_sizes[ZIGMA_MULTI_MAX];
+
+static void bench_plan(uint64 size, int mixed)
+{
+  uint8* data = bench_input;
+
+  for (int m = 0; m < ZIGMA_MULTI_MAX; m++) {
+    bench_handles[m]  = &bench_lanes[m];
+    bench_messages[m] = data;
+    bench_sizes[m]    = !mixed ? size : m % 2 ? size * 7 / 4 : size / 4;
+
+    data += bench_sizes[m];
+  }
+}
+
+static void bench_messages_byte(uint64 size)
+{
+  bench_plan(size, 0);
+
+  for (int m = 0; m < ZIGMA_MULTI_MAX; m++) {
+    for (uint32 i = 0; i < bench_sizes[m]; i++)
+      bench_messages[m][i] = zigma_encrypt_byte(&bench_lanes[m], bench_messages[m][i]);
+  }
+}
+
+static void bench_messages_serial(uint64 size)
+{
+  bench_plan(size, 0);
+
+  for (int m = 0; m < ZIGMA_MULTI_MAX; m++)
+    zigma_encrypt(&bench_lanes[m], bench_messages[m], bench_sizes[m]);
+}
+
+static void bench_messages_multi(uint64 size)
+{
+  bench_plan(size, 0);
+  zigma_encrypt_multi(bench_handles, bench_messages, bench_sizes, ZIGMA_MULTI_MAX);
+}
+
+static void bench_messages_mixed(uint64 size)
+{
+  bench_plan(size, 1);
+  zigma_encrypt_multi(bench_handles, bench_messages, bench_sizes, ZIGMA_MULTI_MAX);
+}
+
+static void bench_hash(uint64 size)
+{
+  zigma_hash_update(&bench_state, bench_input, size);
+}
+
+static void bench_base64_encode(uint64 size)
+{
+  base64_encode(bench_encoded, (char const*) bench_input, size);
+}
+
+/* The encoded form of size bytes, prepared by bench_sweep(). */
+static void bench_base64_decode(uint64 size)
+{
+  base64_decode((char*) bench_output, bench_encoded, (size + 2) / 3 * 4);
+}
+
+/* In place, which leaves clean text as it is. */
+static void bench_base64_sanitize(uint64 size)
+{
+  base64_sanitize(bench_encoded, bench_encoded, (size + 2) / 3 * 4);
+}
+
+static void bench_matrix_resize(uint64 size)
+{
+  matrix_destroy(matrix_resize(matrix_init(NULL, 0), size));
+}
+
+static void bench_memnull(uint64 size)
+{
+  memnull(bench_output, size);
+}
+
+/* Run an operation in batches of doubling length until min_time has passed,
+ * and write out its cost.
+ *   @param bytes The bytes processed by one operation, for the rates.
+ */
+static void bench_run(bench_t* bench, char const* name, bench_op_t* op, uint64 size, uint64 bytes)
+{
+  uint64 iterations = 0;
+  uint64 elapsed    = 0;
+  uint64 ticks      = 0;
+
+  /* Warm up caches, page tables and the branch predictors first. */
+  op(size);
+
+  for (uint64 batch = 1; elapsed < bench->min_time; batch *= 2) {
+    uint64 start_time  = bench_now();
+    uint64 start_ticks = bench_ticks();
+
+    for (uint64 i = 0; i < batch; i++)
+      op(size);
+
+    ticks += bench_ticks() - start_ticks;
+    elapsed += bench_now() - start_time;
+    iterations += batch;
+  }
+
+  double ns     = (double) elapsed / iterations;
+  double cycles = (double) ticks / iterations / bytes;
+  double rate   = (double) bytes * iterations / elapsed;
+
+  fprintf(bench->fp, "%s\n    {\"name\": \"%s\", \"size\": %llu, \"iterations\": %llu, \"ns_per_op\": %.2f, \"cycles_per_byte\": %.3f, \"gb_per_s\": %.4f}",
+          bench->records++ ? "," : "", name, size, iterations, ns, cycles, rate);
+  fflush(bench->fp);
+
+  fprintf(stderr, "%-20s %12llu bytes %14.1f ns/op %9.3f cycles/byte %9.4f GB/s\n", name, size, ns, cycles, rate);
+}
+
+/* Time a bulk operation on every size of the sweep. */
+static void bench_sweep(bench_t* bench, char const* name, bench_op_t* op)
+{
+  for (uint64 size = BENCH_MIN; size <= bench->max; size *= 4) {
+    if (op == bench_base64_decode || op == bench_base64_sanitize)
+      base64_encode(bench_encoded, (char const*) bench_input, size);
+
+    bench_run(bench, name, op, size, size);
+  }
+}
+
+int main(int argc, char const* argv[])
+{
+  bench_t     bench  = {.fp = stdout, .max = 1ULL << 30, .min_time = 200000000ULL};
+  char const* output = NULL;
+
+  for (int i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "of=", 3) == 0)
+      output = argv[i] + 3;
+    else if (strncmp(argv[i], "max=", 4) == 0)
+      bench.max = str2bytes(argv[i] + 4);
+    else if (strncmp(argv[i], "time=", 5) == 0)
+      bench.min_time = strtoull(argv[i] + 5, NULL, 10) * 1000000ULL;
+    else {
+      fprintf(stderr, "usage: %s [of=FILE] [max=BYTES] [time=MS]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (bench.max < BENCH_MIN)
+    bench.max = BENCH_MIN;
+
+  if (output != NULL && (bench.fp = fopen(output, "w")) == NULL) {
+    fprintf(stderr, "ERROR: fopen(): unable to open output file '%s'\n", output);
+    return EXIT_FAILURE;
+  }
+
+  bench_input   = (uint8*) malloc(bench.max);
+  bench_output  = (uint8*) malloc(bench.max);
+  bench_encoded = (char*) malloc(bench.max / 3 * 4 + 64);
+
+  DEBUG_ASSERT(bench_input != NULL && bench_output != NULL && bench_encoded != NULL);
+
+  /* Anything but zeros, so that no path gets an easy ride. */
+  for (uint64 i = 0; i < bench.max; i++)
+    bench_input[i] = (uint8) (i * 2654435761ULL >> 13);
+
+  for (int i = 0; i < 256; i++)
+    bench_passkey[i] = (uint8) (i * 167 + 13);
+
+  bench_key = zigma_init(NULL, bench_passkey, 256);
+  zigma_clone(&bench_state, bench_key);
+
+#ifdef __OPTIMIZE__
+  int optimized = 1;
+#else
+  int optimized = 0;
+#endif
+
+  fprintf(bench.fp, "{\n  \"version\": \"%s\",\n  \"optimized\": %s,\n  \"cycles\": \"%s\",\n  \"results\": [", ZIGMA_VERSION_STRING,
+          optimized ? "true" : "false", BENCH_TSC ? "tsc" : "none");
+
+  /* The key schedule, per key length; zigma_keyrand() is its inner loop. */
+  for (uint64 length = 16; length <= 256; length *= 2)
+    bench_run(&bench, "zigma_init", bench_init, length, length);
+
+  zigma_clone(&bench_state, bench_key);
+
+  for (uint64 length = 16; length <= 256; length *= 2)
+    bench_run(&bench, "zigma_keyrand", bench_keyrand, length, 256);
+
+  zigma_clone(&bench_state, bench_key);
+
+  /* The byte at a time loop runs over 4K, or all there is below max=4K. */
+  uint64 single = bench.max < 4096 ? bench.max : 4096;
+
+  bench_run(&bench, "zigma_encrypt_byte", bench_encrypt_byte, single, single);
+  bench_sweep(&bench, "zigma_encrypt", bench_encrypt);
+  bench_sweep(&bench, "zigma_decrypt", bench_decrypt);
+  bench_sweep(&bench, "zigma_hash_update", bench_hash);
+
+  /* Many short messages: a byte at a time, one after the other, and in
+   * lockstep; "size" is the length of one of ZIGMA_MULTI_MAX messages.
+   */
+  for (int m = 0; m < ZIGMA_MULTI_MAX; m++)
+    zigma_clone(&bench_lanes[m], bench_key);
+
+  for (uint64 size = 64; size * ZIGMA_MULTI_MAX * 2 <= bench.max && size <= 64 * 1024; size *= 4) {
+    bench_run(&bench, "messages_encrypt_byte", bench_messages_byte, size, size * ZIGMA_MULTI_MAX);
+    bench_run(&bench, "messages_encrypt", bench_messages_serial, size, size * ZIGMA_MULTI_MAX);
+    bench_run(&bench, "messages_multi", bench_messages_multi, size, size * ZIGMA_MULTI_MAX);
+    bench_run(&bench, "messages_multi_mixed", bench_messages_mixed, size, size * ZIGMA_MULTI_MAX);
+  }
+
+  /* The cipher scrambled the input in place; restore it for the codec. */
+  for (uint64 i = 0; i < bench.max; i++)
+    bench_input[i] = (uint8) (i * 2654435761ULL >> 13);
+
+  bench_sweep(&bench, "base64_encode", bench_base64_encode);
+  bench_sweep(&bench, "base64_decode", bench_base64_decode);
+  bench_sweep(&bench, "base64_sanitize", bench_base64_sanitize);
+
+  /* Make room for the matrices. */
+  free(bench_encoded);
+  bench_sweep(&bench, "matrix_resize", bench_matrix_resize);
+  bench_sweep(&bench, "memnull", bench_memnull);
+
+  fprintf(bench.fp, "\n  ]\n}\n");
+
+  if (bench.fp != stdout)
+    fclose(bench.fp);
+
+  zigma_destroy(bench_key);
+  memnull(&bench_state, sizeof(zigma_t));
+  memnull(bench_lanes, sizeof(bench_lanes));
+
+  free(bench_input);
+  free(bench_output);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,184 @@
+/*
+ * ZIGMA, Copyright (C) 1999, 2005, 2023 Chase Zehl O'Byrne
+ *  <mail: zehl@live.com> http://zehlchen.com/
+ *
+ * This file is part of ZIGMA.
+ *
+ * ZIGMA is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ZIGMA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ZIGMA; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "checkpoint.h"
+#include "segment.h"
+#include "zigma.h"
+
+/* Snapshot seals are derived like segments, from a disjoint range of indexes. */
+#define CHECKPOINT_DOMAIN (1ULL << 63)
+
+static void checkpoint_write_header(checkpoint_t* ckpt, uint8* header)
+{
+  memcpy(header, CHECKPOINT_MAGIC, 8);
+  pack_uint64(header + 8, ckpt->interval);
+  pack_uint64(header + 16, ckpt->count);
+}
+
+/* Seal and append the current state as the next snapshot. */
+static void checkpoint_record(checkpoint_t* ckpt, zigma_t const* handle)
+{
+  uint8   record[ZIGMA_STATE_SIZE];
+  zigma_t seal;
+
+  segment_derive(&seal, &ckpt->base, CHECKPOINT_DOMAIN | ckpt->count);
+
+  zigma_export(handle, record);
+  zigma_encrypt(&seal, record, ZIGMA_STATE_SIZE);
+
+  fwrite(record, 1, ZIGMA_STATE_SIZE, ckpt->fp);
+
+  ckpt->count++;
+
+  memnull(record, ZIGMA_STATE_SIZE);
+  memnull(&seal, sizeof(zigma_t));
+}
+
+checkpoint_t* checkpoint_create(checkpoint_t* ckpt, FILE* fp, zigma_t const* base, uint64 interval)
+{
+  uint8 header[CHECKPOINT_HEADER_SIZE];
+
+  DEBUG_ASSERT(ckpt != NULL);
+  DEBUG_ASSERT(fp != NULL);
+  DEBUG_ASSERT(interval != 0);
+
+  ckpt->fp       = fp;
+  ckpt->interval = interval;
+  ckpt->count    = 0;
+  ckpt->offset   = 0;
+
+  zigma_clone(&ckpt->base, base);
+
+  /* The count is filled in by checkpoint_finish(). */
+  checkpoint_write_header(ckpt, header);
+  fwrite(header, 1, CHECKPOINT_HEADER_SIZE, fp);
+
+  /* Snapshot 0 is the keyed state itself. */
+  checkpoint_record(ckpt, base);
+
+  return ckpt;
+}
+
+void checkpoint_process(checkpoint_t* ckpt, zigma_t* handle, uint8* data, uint64 size, zigma_cb_t* callback)
+{
+  while (size > 0) {
+    uint64 into = ckpt->offset % ckpt->interval;
+    uint64 step = ckpt->interval - into;
+
+    /* Record each boundary once, when the stream first reaches it. */
+    if (into == 0 && ckpt->offset / ckpt->interval == ckpt->count)
+      checkpoint_record(ckpt, handle);
+
+    if (step > size)
+      step = size;
+
+    callback(handle, data, step);
+
+    ckpt->offset += step;
+    data += step;
+    size -= step;
+  }
+}
+
+int checkpoint_finish(checkpoint_t* ckpt)
+{
+  uint8 header[CHECKPOINT_HEADER_SIZE];
+  int   status = 1;
+
+  checkpoint_write_header(ckpt, header);
+
+  if (fseeko(ckpt->fp, 0, SEEK_SET) != 0 || fwrite(header, 1, CHECKPOINT_HEADER_SIZE, ckpt->fp) != CHECKPOINT_HEADER_SIZE)
+    status = 0;
+
+  if (fflush(ckpt->fp) != 0)
+    status = 0;
+
+  checkpoint_close(ckpt);
+
+  return status;
+}
+
+int checkpoint_open(checkpoint_t* ckpt, FILE* fp, zigma_t const* base)
+{
+  uint8 header[CHECKPOINT_HEADER_SIZE];
+
+  DEBUG_ASSERT(ckpt != NULL);
+  DEBUG_ASSERT(fp != NULL);
+
+  if (fread(header, 1, CHECKPOINT_HEADER_SIZE, fp) != CHECKPOINT_HEADER_SIZE)
+    return 0;
+
+  if (memcmp(header, CHECKPOINT_MAGIC, 8) != 0)
+    return 0;
+
+  ckpt->fp       = fp;
+  ckpt->interval = unpack_uint64(header + 8);
+  ckpt->count    = unpack_uint64(header + 16);
+  ckpt->offset   = 0;
+
+  if (ckpt->interval == 0)
+    return 0;
+
+  zigma_clone(&ckpt->base, base);
+
+  return 1;
+}
+
+sint64 checkpoint_seek(checkpoint_t* ckpt, zigma_t* handle, uint64 target)
+{
+  uint8   record[ZIGMA_STATE_SIZE];
+  uint64  index = target / ckpt->interval;
+  zigma_t seal;
+
+  if (ckpt->count == 0)
+    return -1;
+
+  if (index >= ckpt->count)
+    index = ckpt->count - 1;
+
+  if (fseeko(ckpt->fp, (off_t) (CHECKPOINT_HEADER_SIZE + index * ZIGMA_STATE_SIZE), SEEK_SET) != 0)
+    return -1;
+
+  if (fread(record, 1, ZIGMA_STATE_SIZE, ckpt->fp) != ZIGMA_STATE_SIZE)
+    return -1;
+
+  segment_derive(&seal, &ckpt->base, CHECKPOINT_DOMAIN | index);
+  zigma_decrypt(&seal, record, ZIGMA_STATE_SIZE);
+
+  /* A wrong key or a damaged record does not give back a permutation. */
+  zigma_t* loaded = zigma_import(handle, record);
+
+  memnull(record, ZIGMA_STATE_SIZE);
+  memnull(&seal, sizeof(zigma_t));
+
+  return loaded == NULL ? -1 : (sint64) (index * ckpt->interval);
+}
+
+void checkpoint_close(checkpoint_t* ckpt)
+{
+  memnull(&ckpt->base, sizeof(zigma_t));
+}
@@ -0,0 +1,111 @@
+/*
+ * ZIGMA, Copyright (C) 1999, 2005, 2023 Chase Zehl O'Byrne
+ *  <mail: zehl@live.com> http://zehlchen.com/
+ *
+ * This file is part of ZIGMA.
+ *
+ * ZIGMA is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ZIGMA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ZIGMA; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#pragma once
+#ifndef _ZIGMA_CHECKPOINT_H_
+#define _ZIGMA_CHECKPOINT_H_
+
+#include <stdio.h>
+
+#include "zigma.h"
+
+/* A checkpoint index starts with this magic ... */
+#define CHECKPOINT_MAGIC "ZIGMAIDX"
+
+/* ... followed by the interval (64 bits) and the snapshot count (64 bits),
+ * little-endian, then one sealed ZIGMA_STATE_SIZE record per snapshot.
+ */
+#define CHECKPOINT_HEADER_SIZE 24
+
+/* Default distance between snapshots in bytes. */
+#define CHECKPOINT_INTERVAL (1024 * 1024)
+
+/* A sidecar index of periodic zigma_t snapshots.
+ * Snapshot K holds the state after K * interval bytes of the cryptogram, so
+ * deciphering can start at any offset after at most one interval of work.
+ * Every snapshot is sealed with its own state derived from the key, so any
+ * one of them can be loaded without touching the others.
+ */
+typedef struct checkpoint_t {
+  /* The index file. */
+  FILE* fp;
+
+  /* Distance between snapshots in bytes. */
+  uint64 interval;
+
+  /* Number of snapshots in the index. */
+  uint64 count;
+
+  /* Bytes of the cryptogram processed so far (when writing). */
+  uint64 offset;
+
+  /* The keyed state the snapshots are sealed with. */
+  zigma_t base;
+} checkpoint_t;
+
+/* Starts writing an index.
+ *   @param ckpt The index to initialize.
+ *   @param fp The index file, open for writing.
+ *   @param base The zigma object initialized with the key.
+ *   @param interval The distance between snapshots in bytes (non-zero).
+ *   @return The initialized index.
+ */
+checkpoint_t* checkpoint_create(checkpoint_t* ckpt, FILE* fp, zigma_t const* base, uint64 interval);
+
+/* Runs the cipher over the next bytes of the cryptogram and records a
+ * snapshot at every interval boundary crossed.
+ *   @param ckpt The index being written.
+ *   @param handle The zigma object doing the work.
+ *   @param data The data to encrypt or decrypt in place.
+ *   @param size The size of the data in bytes.
+ *   @param callback zigma_encrypt or zigma_decrypt.
+ */
+void checkpoint_process(checkpoint_t* ckpt, zigma_t* handle, uint8* data, uint64 size, zigma_cb_t* callback);
+
+/* Completes the header of an index that was written and wipes the index.
+ *   @param ckpt The index to finish.
+ *   @return 1 on success, 0 if the index could not be written.
+ */
+int checkpoint_finish(checkpoint_t* ckpt);
+
+/* Opens an index for reading.
+ *   @param ckpt The index to initialize.
+ *   @param fp The index file, open for reading.
+ *   @param base The zigma object initialized with the key.
+ *   @return 1 on success, 0 if the file is not an index.
+ */
+int checkpoint_open(checkpoint_t* ckpt, FILE* fp, zigma_t const* base);
+
+/* Loads the last snapshot at or before an offset.
+ *   @param ckpt The index to read from.
+ *   @param handle The zigma object to populate.
+ *   @param target The offset in the cryptogram to reach.
+ *   @return The offset of the loaded snapshot, or -1 if it is unreadable.
+ */
+sint64 checkpoint_seek(checkpoint_t* ckpt, zigma_t* handle, uint64 target);
+
+/* Wipes the keyed state of an index.
+ *   @param ckpt The index to close.
+ */
+void checkpoint_close(checkpoint_t* ckpt);
+
+#endif /* _ZIGMA_CHECKPOINT_H_ */
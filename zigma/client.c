@@ -0,0 +1,175 @@
+/*
+ * ZIGMA, Copyright (C) 1999, 2005, 2023 Chase Zehl O'Byrne
+ *  <mail: zehl@live.com> http://zehlchen.com/
+ *
+ * This file is part of ZIGMA.
+ *
+ * ZIGMA is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ZIGMA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ZIGMA; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/* A tiny client for the daemon: sends the standard input as one request and
+ * writes the reply to the standard output.
+ *
+ *   $ zigmac SOCKET e|d|h < input > output
+ *   $ zigmac SOCKET E|D KEYFILE < input > output
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "daemon.h"
+#include "zigma.h"
+
+static void client_write(int fd, uint8 const* data, uint64 size)
+{
+  while (size > 0) {
+    ssize_t n = write(fd, data, size);
+
+    if (n < 0 && errno == EINTR)
+      continue;
+
+    if (n <= 0) {
+      fprintf(stderr, "ERROR: write(): %s\n", strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+
+    data += n;
+    size -= n;
+  }
+}
+
+static void client_read(int fd, uint8* data, uint64 size)
+{
+  while (size > 0) {
+    ssize_t n = read(fd, data, size);
+
+    if (n < 0 && errno == EINTR)
+      continue;
+
+    if (n <= 0) {
+      fprintf(stderr, "ERROR: read(): the daemon hung up\n");
+      exit(EXIT_FAILURE);
+    }
+
+    data += n;
+    size -= n;
+  }
+}
+
+int main(int argc, char const* argv[])
+{
+  int keyed = argc == 4 && strlen(argv[2]) == 1 && strchr("ED", argv[2][0]) != NULL;
+
+  if (!keyed && (argc != 3 || strlen(argv[2]) != 1 || strchr("edh", argv[2][0]) == NULL)) {
+    fprintf(stderr, "usage: %s SOCKET e|d|h < INPUT > OUTPUT\n", argv[0]);
+    fprintf(stderr, "       %s SOCKET E|D KEYFILE < INPUT > OUTPUT\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  struct sockaddr_un address = {.sun_family = AF_UNIX};
+  int                fd      = socket(AF_UNIX, SOCK_STREAM, 0);
+
+  strncpy(address.sun_path, argv[1], sizeof(address.sun_path) - 1);
+
+  if (fd < 0 || connect(fd, (struct sockaddr*) &address, sizeof(address)) != 0) {
+    fprintf(stderr, "ERROR: unable to connect to socket '%s': %s\n", argv[1], strerror(errno));
+    return EXIT_FAILURE;
+  }
+
+  /* The whole input, read in growing steps, after the key of a keyed request. */
+  uint64 capacity = 64 * 1024;
+  uint64 length   = 0;
+  uint8* data     = malloc(capacity);
+  size_t count;
+
+  if (keyed && data != NULL) {
+    FILE* key_fp = fopen(argv[3], "r");
+
+    if (key_fp == NULL || (count = fread(data + 1, 1, 256, key_fp)) == 0) {
+      fprintf(stderr, "ERROR: unable to read key file '%s'\n", argv[3]);
+      return EXIT_FAILURE;
+    }
+
+    fclose(key_fp);
+
+    data[0] = (uint8) (count - 1);
+    length  = 1 + count;
+  }
+
+  while (data != NULL && (count = fread(data + length, 1, capacity - length, stdin)) > 0) {
+    length += count;
+
+    if (length == capacity)
+      data = realloc(data, capacity *= 2);
+  }
+
+  if (data == NULL || length > DAEMON_MAX) {
+    fprintf(stderr, "ERROR: the input is larger than %u bytes\n", DAEMON_MAX);
+    return EXIT_FAILURE;
+  }
+
+  uint8 head[DAEMON_HEADER_SIZE] = {(uint8) argv[2][0]};
+
+  for (int i = 0; i < 8; i++)
+    head[1 + i] = (length >> (8 * i)) & 0xFF;
+
+  client_write(fd, head, DAEMON_HEADER_SIZE);
+  client_write(fd, data, length);
+
+  /* Wipe the key; the volatile keeps the stores from being optimized away. */
+  if (keyed) {
+    volatile uint8* key = data;
+
+    for (uint32 i = 0, size = 2 + data[0]; i < size; i++)
+      key[i] = 0;
+  }
+  client_read(fd, head, DAEMON_HEADER_SIZE);
+
+  length = 0;
+
+  for (int i = 0; i < 8; i++)
+    length |= (uint64) head[1 + i] << (8 * i);
+
+  if (length > capacity)
+    data = realloc(data, capacity = length);
+
+  client_read(fd, data, length);
+  close(fd);
+
+  if (head[0] != DAEMON_OK) {
+    fprintf(stderr, "ERROR: %.*s\n", (int) length, (char*) data);
+    return EXIT_FAILURE;
+  }
+
+  if (argv[2][0] == DAEMON_HASH) {
+    for (uint64 i = 0; i < length; i++)
+      printf("%02x", data[i]);
+
+    printf("\n");
+  }
+  else {
+    fwrite(data, 1, length, stdout);
+  }
+
+  free(data);
+
+  return fflush(stdout) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
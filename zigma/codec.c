@@ -0,0 +1,352 @@
+/*
+ * ZIGMA, Copyright (C) 1999, 2005, 2023 Chase Zehl O'Byrne
+ *  <mail: zehl@live.com> http://zehlchen.com/
+ *
+ * This file is part of ZIGMA.
+ *
+ * ZIGMA is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ZIGMA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ZIGMA; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "base64.h"
+#include "codec.h"
+#include "zigma.h"
+
+static void codec_drain(codec_t* codec)
+{
+  if (codec->used != 0 && fwrite(codec->buffer, 1, codec->used, codec->fp) != codec->used) {
+    fprintf(stderr, "ERROR: fwrite(): unable to write output: %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  codec->used = 0;
+}
+
+void codec_begin(codec_t* codec, FILE* fp, int base)
+{
+  codec->fp      = fp;
+  codec->base    = base;
+  codec->column  = 0;
+  codec->carried = 0;
+  codec->used    = 0;
+
+  if (base == 64)
+    fprintf(fp, "##### BEGIN BASE64 #####\n");
+  else if (base == 16)
+    fprintf(fp, "##### BEGIN BASE16 #####\n");
+}
+
+/* Encode whole triples, no further than the end of the current line, and
+ * break the line once it is full.
+ */
+static uint32 codec_line(codec_t* codec, uint8 const* data, uint64 size)
+{
+  uint32 room = (CODEC_LINE - codec->column) / 4 * 3;
+  uint32 step = size < room ? size - size % 3 : room;
+
+  /* One full line, its newline and the terminator written by base64_encode(). */
+  if (codec->used + CODEC_LINE + 2 > CODEC_BUFFER)
+    codec_drain(codec);
+
+  codec->used += base64_encode(codec->buffer + codec->used, (char const*) data, step);
+  codec->column += step / 3 * 4;
+
+  if (codec->column == CODEC_LINE) {
+    codec->buffer[codec->used++] = '\n';
+    codec->column                = 0;
+  }
+
+  return step;
+}
+
+void codec_write(codec_t* codec, uint8 const* data, uint64 size)
+{
+  static const char digits[] = "0123456789ABCDEF";
+
+  if (codec->base == 256) {
+    codec_drain(codec);
+
+    if (fwrite(data, 1, size, codec->fp) != size) {
+      fprintf(stderr, "ERROR: fwrite(): unable to write output: %s\n", strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+  }
+  else if (codec->base == 16) {
+    while (size > 0) {
+      uint64 step = (CODEC_BUFFER - codec->used) / 2;
+
+      step = size < step ? size : step;
+
+      for (uint64 i = 0; i < step; i++) {
+        codec->buffer[codec->used++] = digits[data[i] >> 4];
+        codec->buffer[codec->used++] = digits[data[i] & 15];
+      }
+
+      if (codec->used + 2 > CODEC_BUFFER)
+        codec_drain(codec);
+
+      data += step;
+      size -= step;
+    }
+  }
+  else if (codec->base == 64) {
+    /* Complete a pending triple first. */
+    while (codec->carried > 0 && codec->carried < 3 && size > 0) {
+      codec->carry[codec->carried++] = *data++;
+      size--;
+    }
+
+    if (codec->carried == 3) {
+      codec_line(codec, codec->carry, 3);
+      codec->carried = 0;
+    }
+
+    while (size >= 3) {
+      uint32 step = codec_line(codec, data, size);
+
+      data += step;
+      size -= step;
+    }
+
+    memcpy(codec->carry + codec->carried, data, size);
+    codec->carried += size;
+  }
+}
+
+void codec_flush(codec_t* codec)
+{
+  codec_drain(codec);
+  fflush(codec->fp);
+}
+
+void codec_end(codec_t* codec)
+{
+  if (codec->base == 64) {
+    if (codec->used + 8 > CODEC_BUFFER)
+      codec_drain(codec);
+
+    /* The last one or two bytes, padded. */
+    if (codec->carried > 0) {
+      codec->used += base64_encode(codec->buffer + codec->used, (char const*) codec->carry, codec->carried);
+      codec->column += 4;
+    }
+
+    if (codec->column != 0)
+      codec->buffer[codec->used++] = '\n';
+
+    codec_drain(codec);
+    fprintf(codec->fp, "##### END BASE64 #####\n");
+  }
+  else if (codec->base == 16) {
+    codec_drain(codec);
+    fprintf(codec->fp, "\n##### END BASE16 #####\n");
+  }
+
+  memnull(codec->carry, sizeof(codec->carry));
+  fflush(codec->fp);
+}
+
+int codec_detect(uint8 const* data, uint32 size)
+{
+  static const char armor[] = "##### BEGIN BASE";
+
+  uint32 i = 0;
+
+  while (i < size && (data[i] == ' ' || data[i] == '\t' || data[i] == '\n' || data[i] == '\r'))
+    i++;
+
+  if (size - i < sizeof(armor) + 1 || memcmp(data + i, armor, sizeof(armor) - 1) != 0)
+    return 256;
+
+  if (memcmp(data + i + sizeof(armor) - 1, "64", 2) == 0)
+    return 64;
+
+  if (memcmp(data + i + sizeof(armor) - 1, "16", 2) == 0)
+    return 16;
+
+  return 256;
+}
+
+void decoder_begin(decoder_t* decoder, int base)
+{
+  memset(decoder, 0, sizeof(decoder_t));
+
+  decoder->base       = base;
+  decoder->line_start = 1;
+}
+
+/* Drop whitespace and comment lines, moving the remaining characters to the
+ * front of the buffer.
+ */
+static uint32 decoder_filter(decoder_t* decoder, uint8* data, uint32 size)
+{
+  uint32 kept = 0;
+
+  for (uint32 i = 0; i < size && !decoder->ended; i++) {
+    uint8 ch = data[i];
+
+    if (ch == '\n' || ch == '\r') {
+      /* Stop at the END line; anything after it is not ours. */
+      if (decoder->comment && decoder->line_length >= 9 && memcmp(decoder->line, "##### END", 9) == 0)
+        decoder->ended = 1;
+
+      decoder->line_start  = 1;
+      decoder->comment     = 0;
+      decoder->line_length = 0;
+      continue;
+    }
+
+    if (decoder->comment) {
+      if (decoder->line_length < sizeof(decoder->line))
+        decoder->line[decoder->line_length++] = ch;
+
+      continue;
+    }
+
+    if (ch == ' ' || ch == '\t')
+      continue;
+
+    /* Comments may be indented. */
+    if (decoder->line_start && ch == '#') {
+      decoder->comment     = 1;
+      decoder->line[0]     = ch;
+      decoder->line_length = 1;
+      decoder->line_start  = 0;
+      continue;
+    }
+
+    decoder->line_start = 0;
+    data[kept++]        = ch;
+  }
+
+  return kept;
+}
+
+static int decoder_nibble(uint8 ch)
+{
+  if (ch >= '0' && ch <= '9')
+    return ch - '0';
+  if (ch >= 'A' && ch <= 'F')
+    return ch - 'A' + 10;
+  if (ch >= 'a' && ch <= 'f')
+    return ch - 'a' + 10;
+
+  return -1;
+}
+
+static uint32 decoder_base16(decoder_t* decoder, uint8* data, uint32 kept)
+{
+  uint32 output = 0;
+  uint32 i      = 0;
+
+  /* Output never overtakes input: pair k is read before byte k is written. */
+  if (decoder->pending_length == 1 && kept > 0) {
+    int hi = decoder_nibble(decoder->pending[0]);
+    int lo = decoder_nibble(data[i++]);
+
+    decoder->malformed |= hi < 0 || lo < 0;
+    data[output++]          = hi << 4 | lo;
+    decoder->pending_length = 0;
+  }
+
+  for (; i + 2 <= kept; i += 2) {
+    int hi = decoder_nibble(data[i]);
+    int lo = decoder_nibble(data[i + 1]);
+
+    decoder->malformed |= hi < 0 || lo < 0;
+    data[output++] = hi << 4 | lo;
+  }
+
+  if (i < kept)
+    decoder->pending[decoder->pending_length++] = data[i];
+
+  return output;
+}
+
+static uint32 decoder_base64(decoder_t* decoder, uint8* data, uint32 kept)
+{
+  uint8  first[3];
+  uint32 first_length = 0;
+  uint32 start        = 0;
+
+  if (decoder->pending_length > 0) {
+    /* Complete the pending quartet from the front of the text. */
+    while (decoder->pending_length < 4 && start < kept)
+      decoder->pending[decoder->pending_length++] = data[start++];
+
+    if (decoder->pending_length < 4)
+      return 0;
+
+    first_length            = base64_decode((char*) first, decoder->pending, 4);
+    decoder->malformed     |= first_length == 0;
+    decoder->padded        |= first_length < 3;
+    decoder->pending_length = 0;
+  }
+
+  uint32 whole  = (kept - start) / 4 * 4;
+  uint32 output = 0;
+
+  if (whole > 0) {
+    /* Padding is only allowed at the very end. */
+    decoder->malformed |= decoder->padded;
+
+    /* Decoding in place is safe: the output never catches up with the input. */
+    output = base64_decode((char*) data + start, (char*) data + start, whole);
+
+    decoder->malformed |= output == 0;
+    decoder->padded |= output < whole / 4 * 3;
+  }
+
+  memcpy(decoder->pending, data + start + whole, kept - start - whole);
+  decoder->pending_length = kept - start - whole;
+
+  if (first_length > 0) {
+    memmove(data + first_length, data + start, output);
+    memcpy(data, first, first_length);
+  }
+  else if (start > 0) {
+    memmove(data, data + start, output);
+  }
+
+  return first_length + output;
+}
+
+uint32 decoder_run(decoder_t* decoder, uint8* data, uint32 size)
+{
+  int    padded = decoder->padded;
+  uint32 kept   = decoder_filter(decoder, data, size);
+
+  /* Characters after the padding are an error; the END line is not. */
+  if (padded && kept > 0)
+    decoder->malformed = 1;
+
+  if (decoder->malformed || kept == 0)
+    return 0;
+
+  if (decoder->base == 16)
+    return decoder_base16(decoder, data, kept);
+
+  return decoder_base64(decoder, data, kept);
+}
+
+int decoder_end(decoder_t* decoder)
+{
+  return !decoder->malformed && decoder->pending_length == 0 && decoder->ended;
+}
@@ -0,0 +1,143 @@
+/*
+ * ZIGMA, Copyright (C) 1999, 2005, 2023 Chase Zehl O'Byrne
+ *  <mail: zehl@live.com> http://zehlchen.com/
+ *
+ * This file is part of ZIGMA.
+ *
+ * ZIGMA is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ZIGMA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ZIGMA; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#pragma once
+#ifndef _ZIGMA_CODEC_H_
+#define _ZIGMA_CODEC_H_
+
+#include <stdio.h>
+
+#include "zigma.h"
+
+/* Size of the output buffer of a codec. */
+#define CODEC_BUFFER (64 * 1024)
+
+/* Characters per line of base64 output. */
+#define CODEC_LINE 80
+
+/* Incremental writer for the cryptogram formats: raw, base16 and base64. */
+typedef struct codec_t {
+  /* The output. */
+  FILE* fp;
+
+  /* One of 256 (raw), 16 or 64. */
+  int base;
+
+  /* Characters written on the current base64 line. */
+  uint32 column;
+
+  /* Bytes waiting for a complete base64 triple. */
+  uint8  carry[3];
+  uint32 carried;
+
+  /* Encoded output not yet handed to the stream. */
+  uint32 used;
+  char   buffer[CODEC_BUFFER];
+} codec_t;
+
+/* Starts the output, writing the BEGIN armor line for base16 and base64.
+ *   @param codec The codec to initialize.
+ *   @param fp The output.
+ *   @param base The format: 256, 16 or 64.
+ */
+void codec_begin(codec_t* codec, FILE* fp, int base);
+
+/* Encodes data, which may come in pieces of any size. The output is the same
+ * as if everything had been written at once.
+ *   @param codec The codec to write with.
+ *   @param data The data to encode.
+ *   @param size The size of the data in bytes.
+ */
+void codec_write(codec_t* codec, uint8 const* data, uint64 size);
+
+/* Hands everything encoded so far to the output and flushes it.
+ *   @param codec The codec to flush.
+ */
+void codec_flush(codec_t* codec);
+
+/* Encodes what is left, writes the END armor line and flushes the output.
+ *   @param codec The codec to finish.
+ */
+void codec_end(codec_t* codec);
+
+/* Recognizes the format of a cryptogram from its first bytes: armored
+ * base64 or base16, possibly after some whitespace, or else raw.
+ *   @param data The start of the input.
+ *   @param size The number of bytes available, at least CODEC_DETECT unless
+ *               the input is shorter.
+ *   @return 64, 16 or 256.
+ */
+int codec_detect(uint8 const* data, uint32 size);
+
+/* Number of bytes codec_detect() wants to look at. */
+#define CODEC_DETECT 64
+
+/* Incremental reader for armored cryptograms. Whitespace and the lines that
+ * start with '#' are skipped, and nothing after the END line is read.
+ */
+typedef struct decoder_t {
+  /* One of 16 or 64. */
+  int base;
+
+  /* Set at the start of a line (before anything but blanks), inside a comment
+   * line, after the END line and after the base64 padding.
+   */
+  int line_start;
+  int comment;
+  int ended;
+  int padded;
+
+  /* The start of the current comment line, to recognize the END line. */
+  char   line[16];
+  uint32 line_length;
+
+  /* Characters waiting for a complete base64 quartet or base16 pair. */
+  char   pending[4];
+  uint32 pending_length;
+
+  /* Set once anything but the alphabet turned up outside comments. */
+  int malformed;
+} decoder_t;
+
+/* Initializes an armored input reader.
+ *   @param decoder The decoder to initialize.
+ *   @param base The format, 16 or 64, as found by codec_detect().
+ */
+void decoder_begin(decoder_t* decoder, int base);
+
+/* Decodes the next piece of armored text in place; the pieces may be split
+ * anywhere.
+ *   @param decoder The decoder.
+ *   @param data The text, replaced by the decoded bytes.
+ *   @param size The length of the text.
+ *   @return The number of decoded bytes at the start of data.
+ */
+uint32 decoder_run(decoder_t* decoder, uint8* data, uint32 size);
+
+/* Checks that the armored text was well-formed and complete, up to the END
+ * line.
+ *   @param decoder The decoder.
+ *   @return 1 if the text was valid, 0 otherwise.
+ */
+int decoder_end(decoder_t* decoder);
+
+#endif /* _ZIGMA_CODEC_H_ */
@@ -0,0 +1,78 @@
+/*
+ * ZIGMA, Copyright (C) 1999, 2005, 2023 Chase Zehl O'Byrne
+ *  <mail: zehl@live.com> http://zehlchen.com/
+ *
+ * This file is part of ZIGMA.
+ *
+ * ZIGMA is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ZIGMA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ZIGMA; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "context.h"
+#include "zigma.h"
+
+zigma_context_t* zigma_context_init(zigma_context_t* context, zigma_mode_t mode, zigma_t const* key)
+{
+  DEBUG_ASSERT(context != NULL);
+
+  if (mode != ZIGMA_HASH && key == NULL)
+    return NULL;
+
+  context->mode   = mode;
+  context->length = 0;
+  context->state  = mode == ZIGMA_HASH ? zigma_init(NULL, NULL, 0) : zigma_clone(NULL, key);
+
+  return context;
+}
+
+void zigma_context_update(zigma_context_t* context, uint8 const* input, uint8* output, uint64 size)
+{
+  DEBUG_ASSERT(context != NULL && context->state != NULL);
+
+  switch (context->mode) {
+    case ZIGMA_ENCRYPT:
+      zigma_encrypt_copy(context->state, input, output, size);
+      break;
+
+    case ZIGMA_DECRYPT:
+      zigma_decrypt_copy(context->state, input, output, size);
+      break;
+
+    case ZIGMA_HASH:
+      zigma_hash_update(context->state, input, size);
+      break;
+  }
+
+  context->length += size;
+}
+
+uint64 zigma_context_final(zigma_context_t* context, uint8* checksum, uint32 length)
+{
+  DEBUG_ASSERT(context != NULL && context->state != NULL);
+
+  uint64 total = context->length;
+
+  /* A shorter checksum is the front of a longer one. */
+  if (context->mode == ZIGMA_HASH && checksum != NULL)
+    zigma_hash_sign(context->state, checksum, length);
+
+  context->state  = zigma_destroy(context->state);
+  context->length = 0;
+
+  return total;
+}
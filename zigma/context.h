@@ -0,0 +1,74 @@
+/*
+ * ZIGMA, Copyright (C) 1999, 2005, 2023 Chase Zehl O'Byrne
+ *  <mail: zehl@live.com> http://zehlchen.com/
+ *
+ * This file is part of ZIGMA.
+ *
+ * ZIGMA is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ZIGMA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ZIGMA; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#pragma once
+#ifndef _ZIGMA_CONTEXT_H_
+#define _ZIGMA_CONTEXT_H_
+
+#include "zigma.h"
+
+/* What a context does with the data fed to it. */
+typedef enum { ZIGMA_ENCRYPT = 0, ZIGMA_DECRYPT, ZIGMA_HASH } zigma_mode_t;
+
+/* A message being enciphered, deciphered or hashed piece by piece. Contexts
+ * share nothing, so any number of them may be used at once, on any threads;
+ * feeding a message in pieces gives the same result as feeding it whole.
+ */
+typedef struct zigma_context_t {
+  /* What the context does. */
+  zigma_mode_t mode;
+
+  /* The cipher (or hash) state, in locked memory. */
+  zigma_t* state;
+
+  /* Bytes fed so far. */
+  uint64 length;
+} zigma_context_t;
+
+/* Starts a message. The key is expanded once with zigma_init() and may then
+ * start any number of contexts; it is copied, not modified.
+ *   @param context The context to initialize.
+ *   @param mode ZIGMA_ENCRYPT, ZIGMA_DECRYPT or ZIGMA_HASH.
+ *   @param key The zigma object initialized with the key, or NULL to hash.
+ *   @return The context, or NULL if a key is missing for a cipher mode.
+ */
+ZIGMA_API zigma_context_t* zigma_context_init(zigma_context_t* context, zigma_mode_t mode, zigma_t const* key);
+
+/* Feeds the next piece of the message.
+ *   @param context The context to feed.
+ *   @param input The piece of the message.
+ *   @param output The buffer receiving the enciphered or deciphered piece,
+ *                 which may be input itself; NULL when hashing.
+ *   @param size The size of the piece in bytes.
+ */
+ZIGMA_API void zigma_context_update(zigma_context_t* context, uint8 const* input, uint8* output, uint64 size);
+
+/* Ends the message and wipes the context.
+ *   @param context The context to finish.
+ *   @param checksum The buffer receiving the checksum when hashing, or NULL.
+ *   @param length The length of the checksum in bytes (ZIGMA_CHECKSUM_SIZE;
+ *                 'zigma h' prints the first 24).
+ *   @return The number of bytes fed to the context.
+ */
+ZIGMA_API uint64 zigma_context_final(zigma_context_t* context, uint8* checksum, uint32 length);
+
+#endif /* _ZIGMA_CONTEXT_H_ */
@@ -0,0 +1,404 @@
+/*
+ * ZIGMA, Copyright (C) 1999, 2005, 2023 Chase Zehl O'Byrne
+ *  <mail: zehl@live.com> http://zehlchen.com/
+ *
+ * This file is part of ZIGMA.
+ *
+ * ZIGMA is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ZIGMA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ZIGMA; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/* For accept4(). */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+
+#include "daemon.h"
+#include "keycache.h"
+#include "matrix.h"
+#include "zigma.h"
+
+#ifdef __linux__
+
+/* A client connection: the request being read or the reply being written. */
+typedef struct daemon_conn_t {
+  int fd;
+
+  /* The header of the request, then of the reply, and how much of it is in. */
+  uint8  head[DAEMON_HEADER_SIZE];
+  uint32 head_length;
+
+  /* The payload of the request, replaced by the reply in place. */
+  matrix_t* body;
+  uint64    length;
+
+  /* Bytes of the payload received, or of the whole reply sent. */
+  uint64 done;
+
+  /* Set while the reply is being written, when it is the last one, and
+   * while waiting for the socket to take the rest of it.
+   */
+  int writing;
+  int closing;
+  int waiting;
+} daemon_conn_t;
+
+static volatile sig_atomic_t daemon_stop;
+
+static void daemon_signal(int signum)
+{
+  (void) signum;
+
+  daemon_stop = 1;
+}
+
+static void daemon_close(int epoll_fd, daemon_conn_t* conn)
+{
+  epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+  close(conn->fd);
+
+  if (conn->body != NULL)
+    matrix_destroy(conn->body);
+
+  free(conn);
+}
+
+/* Make room for a payload, and for any reply. */
+static void daemon_room(daemon_conn_t* conn, uint64 size)
+{
+  if (conn->body == NULL)
+    conn->body = matrix_init(NULL, 0);
+
+  matrix_reserve(conn->body, size > 64 ? size : 64);
+}
+
+static void daemon_reply(daemon_conn_t* conn, uint8 status, uint8 const* data, uint64 length)
+{
+  /* The data may sit further along the payload itself. */
+  if (data != NULL)
+    memmove(conn->body->data, data, length);
+
+  conn->head[0] = status;
+  pack_uint64(conn->head + 1, length);
+
+  conn->length  = length;
+  conn->done    = 0;
+  conn->writing = 1;
+  conn->closing = status != DAEMON_OK;
+}
+
+static void daemon_fail(daemon_conn_t* conn, char const* message)
+{
+  daemon_room(conn, strlen(message));
+  daemon_reply(conn, DAEMON_ERROR, (uint8 const*) message, strlen(message));
+}
+
+/* Run a complete request in place, from a copy of the keyed (or hash) state,
+ * or of the state cached for the key that comes with the request.
+ */
+static void daemon_process(daemon_conn_t* conn, zigma_t const* key, zigma_t const* hash, keycache_t* cache, zigma_t* state)
+{
+  uint8* data = conn->body->data;
+
+  switch (conn->head[0]) {
+    case DAEMON_ENCRYPT:
+      zigma_encrypt(zigma_clone(state, key), data, conn->length);
+      daemon_reply(conn, DAEMON_OK, NULL, conn->length);
+      break;
+
+    case DAEMON_DECRYPT:
+      zigma_decrypt(zigma_clone(state, key), data, conn->length);
+      daemon_reply(conn, DAEMON_OK, NULL, conn->length);
+      break;
+
+    case DAEMON_HASH: {
+      uint8 checksum[32];
+
+      zigma_hash_update(zigma_clone(state, hash), data, conn->length);
+      zigma_hash_sign(state, checksum, 32);
+      daemon_reply(conn, DAEMON_OK, checksum, DAEMON_DIGEST);
+      break;
+    }
+
+    case DAEMON_ENCRYPT_KEYED:
+    case DAEMON_DECRYPT_KEYED: {
+      uint64 keylen = conn->length > 0 ? data[0] + 1ULL : 0;
+
+      if (conn->length < 1 + keylen) {
+        daemon_fail(conn, "missing key");
+        break;
+      }
+
+      uint8* message = data + 1 + keylen;
+      uint64 size    = conn->length - 1 - keylen;
+
+      keycache_fetch(cache, state, data + 1, (uint32) keylen);
+      memnull(data, 1 + keylen);
+
+      if (conn->head[0] == DAEMON_ENCRYPT_KEYED)
+        zigma_encrypt(state, message, size);
+      else
+        zigma_decrypt(state, message, size);
+
+      daemon_reply(conn, DAEMON_OK, message, size);
+      break;
+    }
+
+    default:
+      daemon_fail(conn, "unknown operation");
+      break;
+  }
+
+  memnull(state, sizeof(zigma_t));
+}
+
+/* Write as much of the reply as the socket takes.
+ *   @return 1 once the reply is out, 0 if the socket is full, -1 on error.
+ */
+static int daemon_send(daemon_conn_t* conn)
+{
+  while (conn->done < DAEMON_HEADER_SIZE + conn->length) {
+    struct iovec io[2];
+    int          count = 0;
+
+    if (conn->done < DAEMON_HEADER_SIZE) {
+      io[count].iov_base = conn->head + conn->done;
+      io[count].iov_len  = DAEMON_HEADER_SIZE - conn->done;
+      count++;
+    }
+
+    uint64 sent = conn->done < DAEMON_HEADER_SIZE ? 0 : conn->done - DAEMON_HEADER_SIZE;
+
+    if (sent < conn->length) {
+      io[count].iov_base = conn->body->data + sent;
+      io[count].iov_len  = conn->length - sent;
+      count++;
+    }
+
+    ssize_t n = writev(conn->fd, io, count);
+
+    if (n < 0 && errno == EINTR)
+      continue;
+
+    if (n < 0)
+      return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+
+    conn->done += n;
+  }
+
+  /* Ready for the next request. */
+  conn->writing     = 0;
+  conn->head_length = 0;
+  conn->done        = 0;
+
+  return 1;
+}
+
+/* Read whatever the socket holds, and answer every request completed by it.
+ *   @return 1 to keep the connection, 0 to close it.
+ */
+static int daemon_serve_conn(int epoll_fd, daemon_conn_t* conn, zigma_t const* key, zigma_t const* hash, keycache_t* cache, zigma_t* state,
+                             uint64* served)
+{
+  while (1) {
+    if (conn->writing) {
+      int sent = daemon_send(conn);
+
+      if (sent < 0 || (sent > 0 && conn->closing))
+        return 0;
+
+      /* Wait until the socket drains, reading no further requests meanwhile. */
+      if (sent == conn->waiting) {
+        struct epoll_event event = {.events = sent ? EPOLLIN : EPOLLOUT, .data.ptr = conn};
+
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn->fd, &event);
+        conn->waiting = !sent;
+      }
+
+      if (!sent)
+        return 1;
+    }
+
+    ssize_t n;
+
+    if (conn->head_length < DAEMON_HEADER_SIZE)
+      n = read(conn->fd, conn->head + conn->head_length, DAEMON_HEADER_SIZE - conn->head_length);
+    else
+      n = read(conn->fd, conn->body->data + conn->done, conn->length - conn->done);
+
+    if (n < 0 && errno == EINTR)
+      continue;
+
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      return 1;
+
+    /* The client hung up, or something went wrong. */
+    if (n <= 0)
+      return 0;
+
+    if (conn->head_length < DAEMON_HEADER_SIZE) {
+      conn->head_length += n;
+
+      if (conn->head_length < DAEMON_HEADER_SIZE)
+        continue;
+
+      conn->length = unpack_uint64(conn->head + 1);
+      conn->done   = 0;
+
+      if (conn->length > DAEMON_MAX) {
+        daemon_fail(conn, "request too large");
+        continue;
+      }
+
+      daemon_room(conn, conn->length);
+    }
+    else {
+      conn->done += n;
+    }
+
+    if (conn->done == conn->length) {
+      daemon_process(conn, key, hash, cache, state);
+      (*served)++;
+    }
+  }
+}
+
+uint64 daemon_serve(char const* path, zigma_t const* key)
+{
+  struct sockaddr_un address = {.sun_family = AF_UNIX};
+  struct sigaction   action  = {.sa_handler = daemon_signal};
+  uint64             served  = 0;
+
+  DEBUG_ASSERT(path != NULL);
+  DEBUG_ASSERT(key != NULL);
+
+  if (strlen(path) >= sizeof(address.sun_path)) {
+    fprintf(stderr, "ERROR: the socket path '%s' is too long\n", path);
+    exit(EXIT_FAILURE);
+  }
+
+  strcpy(address.sun_path, path);
+
+  int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+  /* Only the owner may connect. */
+  mode_t mask = umask(0077);
+
+  if (listen_fd < 0 || bind(listen_fd, (struct sockaddr*) &address, sizeof(address)) != 0 || listen(listen_fd, SOMAXCONN) != 0) {
+    fprintf(stderr, "ERROR: unable to listen on socket '%s': %s\n", path, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  umask(mask);
+
+  int                epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  struct epoll_event event    = {.events = EPOLLIN, .data.ptr = NULL};
+
+  if (epoll_fd < 0 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event) != 0) {
+    fprintf(stderr, "ERROR: epoll(): %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  /* No SA_RESTART, so that epoll_wait() returns on a signal. */
+  daemon_stop = 0;
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+  signal(SIGPIPE, SIG_IGN);
+
+  zigma_t* hash  = zigma_init(NULL, NULL, 0);
+  zigma_t* state = zigma_clone(NULL, key);
+
+  /* Keys sent with requests are expanded once, then served from here. */
+  keycache_t* cache = keycache_init(NULL, DAEMON_KEYS);
+
+  fprintf(stderr, "Listening on socket '%s'\n", path);
+
+  while (!daemon_stop) {
+    struct epoll_event events[64];
+    int                count = epoll_wait(epoll_fd, events, 64, -1);
+
+    if (count < 0 && errno != EINTR) {
+      fprintf(stderr, "ERROR: epoll_wait(): %s\n", strerror(errno));
+      break;
+    }
+
+    for (int i = 0; i < count; i++) {
+      daemon_conn_t* conn = events[i].data.ptr;
+
+      /* New connections. */
+      if (conn == NULL) {
+        int fd;
+
+        while ((fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+          conn = (daemon_conn_t*) calloc(1, sizeof(daemon_conn_t));
+
+          DEBUG_ASSERT(conn != NULL);
+
+          conn->fd = fd;
+
+          struct epoll_event added = {.events = EPOLLIN, .data.ptr = conn};
+
+          if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &added) != 0) {
+            close(fd);
+            free(conn);
+          }
+        }
+
+        continue;
+      }
+
+      if (!daemon_serve_conn(epoll_fd, conn, key, hash, cache, state, &served))
+        daemon_close(epoll_fd, conn);
+    }
+  }
+
+  fprintf(stderr, "Stopped after %llu requests (%llu keys expanded, %llu reused)\n", served, cache->misses, cache->hits);
+
+  close(epoll_fd);
+  close(listen_fd);
+  unlink(path);
+
+  keycache_destroy(cache);
+  zigma_destroy(state);
+  zigma_destroy(hash);
+
+  return served;
+}
+
+#else
+
+uint64 daemon_serve(char const* path, zigma_t const* key)
+{
+  (void) path;
+  (void) key;
+
+  fprintf(stderr, "ERROR: the daemon needs epoll, which this system does not have\n");
+  exit(EXIT_FAILURE);
+}
+
+#endif
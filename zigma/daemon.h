@@ -0,0 +1,75 @@
+/*
+ * ZIGMA, Copyright (C) 1999, 2005, 2023 Chase Zehl O'Byrne
+ *  <mail: zehl@live.com> http://zehlchen.com/
+ *
+ * This file is part of ZIGMA.
+ *
+ * ZIGMA is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ZIGMA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ZIGMA; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#pragma once
+#ifndef _ZIGMA_DAEMON_H_
+#define _ZIGMA_DAEMON_H_
+
+#include "zigma.h"
+
+/* A request is a one byte operation followed by the payload length (64 bits,
+ * little-endian) and the payload. The reply has the same shape, with a status
+ * in place of the operation and the result (or an error message) as payload.
+ * A connection may carry any number of requests, one after the other.
+ */
+#define DAEMON_HEADER_SIZE 9
+
+/* Operations: encipher or decipher the payload with the key of the daemon, as
+ * 'zigma e fmt=256' and 'zigma d' would, or hash it as 'zigma h' would.
+ */
+#define DAEMON_ENCRYPT 'e'
+#define DAEMON_DECRYPT 'd'
+#define DAEMON_HASH    'h'
+
+/* Keyed operations: as above, but with a key of their own. The payload starts
+ * with the length of the key less one (a single byte) and the key, followed
+ * by the message. Keys are expanded once and kept in a cache of the daemon,
+ * so that a client may switch between a few keys at no cost.
+ */
+#define DAEMON_ENCRYPT_KEYED 'E'
+#define DAEMON_DECRYPT_KEYED 'D'
+
+/* Number of expanded keys the daemon keeps for the keyed operations. */
+#define DAEMON_KEYS 64
+
+/* Reply status. The daemon hangs up after an error. */
+#define DAEMON_OK    0
+#define DAEMON_ERROR 1
+
+/* Largest payload accepted. */
+#define DAEMON_MAX (64 * 1024 * 1024)
+
+/* Length of the checksum returned for DAEMON_HASH. */
+#define DAEMON_DIGEST 24
+
+/* Serves requests on a Unix domain socket until SIGINT or SIGTERM. The key is
+ * expanded once by the caller; every message starts from a copy of the keyed
+ * state (or from the cached state of the key of a keyed request), so requests
+ * are independent of each other. Connections are served by one thread from an
+ * epoll event loop.
+ *   @param path The path of the socket, which is created (and removed at the end).
+ *   @param key The zigma object initialized with the key (not modified).
+ *   @return The number of requests served.
+ */
+uint64 daemon_serve(char const* path, zigma_t const* key);
+
+#endif /* _ZIGMA_DAEMON_H_ */
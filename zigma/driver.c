@@ -22,10 +22,14 @@
 
 #include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
 #include <unistd.h>
 
 #ifdef __linux__
@@ -33,8 +37,24 @@
 #endif
 
 #include "base64.h"
+#include "checkpoint.h"
+#include "codec.h"
+#include "daemon.h"
+#include "hashstate.h"
+#include "hashtree.h"
+#include "keystream.h"
 #include "kvlist.h"
+#include "manifest.h"
 #include "matrix.h"
+#include "pipeline.h"
+#include "pool.h"
+#include "secure.h"
+#include "segment.h"
+#include "selftest.h"
+#include "stats.h"
+#include "stream.h"
+#include "tree.h"
+#include "window.h"
 #include "zigma.h"
 
 enum command_mode_t {
@@ -43,10 +63,12 @@ enum command_mode_t {
   MODE_DECRYPT,
   MODE_HASH,
   MODE_RANDOM,
+  MODE_SELFTEST,
+  MODE_SERVE,
 };
 
-/* Generalized callback for encrypt/decrypt */
-typedef void(zigma_cb_t)(zigma_t*, uint8*, uint32);
+/* Debug Verbosity */
+typedef enum { DEBUG_NONE = 0, DEBUG_LOW, DEBUG_MEDIUM, DEBUG_HIGH } debug_level_t;
 
 debug_level_t DEBUG_LEVEL = DEBUG_HIGH;
 
@@ -60,12 +82,32 @@ void print_usage(char const* myself)
           "    d, decode     restore a cryptogram\n"
           "    h, hash       compute standardized checksum\n"
           "    r, random     generate pseudorandom data\n"
+          "    t, test       cross-check the cipher kernels\n"
+          "    s, serve      serve e, d and h requests on a Unix socket\n"
           "\n"
           "  and OPERAND may be any of:\n"
-          "    if=FILE       input file (instead of STDIN)\n"
-          "    of=FILE       output file (instead of STDOUT)\n"
+          "    if=FILE       input file (instead of STDIN); a directory for a whole tree\n"
+          "    of=FILE       output file (instead of STDOUT); the output directory for a tree\n"
           "    key=FILE      use a key file instead of PASSPHRASE\n"
-          "    fmt=BASE      force format base: 16, 64, or 256\n"
+          "    fmt=BASE      output format (e): 16, 64, or 256; d detects it\n"
+          "    seg=BYTES     encipher into independently keyed segments of BYTES\n"
+          "    threads=N     worker threads for segments and trees (default: all processors)\n"
+          "    bs=BYTES      block size for skip, seek and count (default: 512)\n"
+          "    skip=N        skip N input blocks\n"
+          "    seek=N        skip N output blocks\n"
+          "    count=N       process only N input blocks\n"
+          "    win=BYTES     shuffle the cryptogram in windows of BYTES (e)\n"
+          "    idx=FILE      checkpoint index to write (e) or to start deciphering from (d)\n"
+          "    ckpt=BYTES    distance between checkpoints in the index (default: 1M)\n"
+          "    io=MODE       stream (default: block by block) or buffer (whole input)\n"
+          "    leaf=BYTES    hash as a tree of BYTES-sized leaves, in parallel\n"
+          "    state=FILE    resume hashing a growing file from FILE and update it (h)\n"
+          "    sum=LIST      hash the files listed in LIST (- for STDIN) in parallel (h)\n"
+          "    check=FILE    verify the checksums listed in FILE, as written by sum= (h)\n"
+          "    seed=STRING   seed for random instead of a key file\n"
+          "    streams=N     interleave N independent random streams (default: 1)\n"
+          "    sock=PATH     Unix socket to serve requests on (s)\n"
+          "    stats=MODE    report stage timings, peak RSS and allocations: 1 or json\n"
           "\n"
           "N and BYTES may use one of the following multiplicative suffixes:\n"
           " C=1, K=1024, M=1024*1024, G=1024*1024*1024\n"
@@ -88,6 +130,56 @@ void import_defaults(kvlist_t** head)
 
   /* Format override (normal: autodetect) binary, base16, base64 */
   _KV("fmt", "64");
+
+  /* Segment size (default "0": one continuous stream) */
+  _KV("seg", "0");
+
+  /* Worker threads (default "0": one per processor) */
+  _KV("threads", "0");
+
+  /* Block size for skip, seek and count (default "512", like dd) */
+  _KV("bs", "512");
+
+  /* Input and output blocks to skip (default "0") */
+  _KV("skip", "0");
+  _KV("seek", "0");
+
+  /* Input blocks to process (default "": all of them) */
+  _KV("count", "");
+
+  /* Shuffle window (default "0": no shuffle) */
+  _KV("win", "0");
+
+  /* Checkpoint index file (default "": none) */
+  _KV("idx", "");
+
+  /* Checkpoint interval (default "1M") */
+  _KV("ckpt", "1M");
+
+  /* Input handling (default "stream": block by block; "buffer": all at once) */
+  _KV("io", "stream");
+
+  /* Hash tree leaf size (default "0": serial hash) */
+  _KV("leaf", "0");
+
+  /* Hash state file (default "": hash the whole input) */
+  _KV("state", "");
+
+  /* File list to sum and checksum list to verify (default "": none) */
+  _KV("sum", "");
+  _KV("check", "");
+
+  /* Random seed (default "": key file, or /dev/urandom) */
+  _KV("seed", "");
+
+  /* Random streams (default "1") */
+  _KV("streams", "1");
+
+  /* Daemon socket (default "": none) */
+  _KV("sock", "");
+
+  /* Stage timings (default "0": none; "1": one line; "json") */
+  _KV("stats", "0");
 #undef _KV
 }
 
@@ -109,8 +201,20 @@ unsigned long get_passwd(uint8* buffer, uint8* prompt)
   int index = 0;
 
   while (1) {
-    char ch = getchar();
-    if (ch == '\n' || ch == '\r') { // Enter key
+    char    ch;
+    ssize_t count = read(STDIN_FILENO, &ch, 1);
+
+    /* Byte by byte past stdio, so that nothing after the passphrase is
+     * buffered where read_block() would not see it.
+     */
+    if (count < 0 && errno == EINTR)
+      continue;
+
+    if (count <= 0) { // End of input
+      buffer[index] = '\0';
+      break;
+    }
+    else if (ch == '\n' || ch == '\r') { // Enter key
       buffer[index] = '\0';
       break;
     }
@@ -135,6 +239,30 @@ unsigned long get_passwd(uint8* buffer, uint8* prompt)
   return index;
 }
 
+/* Read up to the first 256 bytes of a key file. */
+uint32 read_keyfile(char const* path, uint8* passkey)
+{
+  FILE* key_fp = fopen(path, "r");
+
+  if (key_fp == NULL) {
+    fprintf(stderr, "ERROR: fopen(): unable to open key file '%s': %s!\n", path, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  uint32 keylen = fread(passkey, 1, 256, key_fp);
+
+  if (keylen == 0) {
+    fprintf(stderr, "ERROR: fread(): unable to read key file '%s': %s!\n", path, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  fprintf(stderr, "Read %u bytes from key file '%s'!\n", keylen, path);
+
+  fclose(key_fp);
+
+  return keylen;
+}
+
 void debug_printf(debug_level_t level, char const* format, ...)
 {
   if (level <= DEBUG_LEVEL) {
@@ -146,55 +274,318 @@ void debug_printf(debug_level_t level, char const* format, ...)
   }
 }
 
-/* Convert using multiplicative suffixes */
-uint32 str2bytes(char const* str)
+/* dd-style positioning operands, in bytes. */
+typedef struct span_t {
+  /* Input bytes to skip. */
+  uint64 skip;
+
+  /* Output bytes to skip. */
+  uint64 seek;
+
+  /* Input bytes to process, (uint64) -1 for all of them. */
+  uint64 count;
+} span_t;
+
+void parse_span(kvlist_t** head, span_t* span)
 {
-  int len = strlen(str);
-
-  char suffix = str[len - 1];
-
-  unsigned long value = strtoul(str, NULL, 0);
-
-  switch (suffix) {
-    case 'C':
-    case 'c':
-      return value;
-    case 'K':
-    case 'k':
-      return 1024 * value;
-    case 'M':
-    case 'm':
-      return 1024 * 1024 * value;
-    case 'G':
-    case 'g':
-      return 1024 * 1024 * 1024 * value;
-    default:
-      return value;
+  kvlist_t* bs    = kvlist_search(head, "bs");
+  kvlist_t* skip  = kvlist_search(head, "skip");
+  kvlist_t* seek  = kvlist_search(head, "seek");
+  kvlist_t* count = kvlist_search(head, "count");
+
+  DEBUG_ASSERT(bs != NULL);
+  DEBUG_ASSERT(skip != NULL);
+  DEBUG_ASSERT(seek != NULL);
+  DEBUG_ASSERT(count != NULL);
+
+  uint64 block_size = str2bytes(bs->value);
+
+  if (block_size == 0) {
+    fprintf(stderr, "ERROR: invalid block size 'bs=%s'\n", bs->value);
+    exit(EXIT_FAILURE);
+  }
+
+  span->skip  = block_size * str2bytes(skip->value);
+  span->seek  = block_size * str2bytes(seek->value);
+  span->count = *count->value != 0 ? block_size * str2bytes(count->value) : (uint64) -1;
+}
+
+/* Discard input bytes, seeking when the input allows it. */
+int skip_input(FILE* fp, uint64 bytes)
+{
+  uint8 buffer[4096];
+
+  if (bytes == 0 || fseeko(fp, (off_t) bytes, SEEK_CUR) == 0)
+    return 1;
+
+  while (bytes > 0) {
+    uint32 count = read_block(fp, buffer, bytes < sizeof(buffer) ? bytes : sizeof(buffer));
+
+    if (count == 0)
+      return 0;
+
+    bytes -= count;
+  }
+
+  return 1;
+}
+
+/* Position the output, which must be seekable unless bytes is 0. */
+void seek_output(FILE* fp, uint64 bytes)
+{
+  if (bytes != 0 && fseeko(fp, (off_t) bytes, SEEK_SET) != 0) {
+    fprintf(stderr, "ERROR: fseeko(): unable to seek output to %llu: %s\n", bytes, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+}
+
+/* Read the rest of the input, at most limit more bytes, into a matrix that
+ * already holds total bytes. A regular file is read straight into a matrix
+ * sized for it up front; anything else grows the matrix geometrically.
+ */
+uint64 read_input(FILE* fp, matrix_t* matrix, uint64 total, uint64 limit)
+{
+  struct stat st;
+  off_t       position = ftello(fp);
+  uint64      initial  = total;
+
+  STATS_BEGIN(read_time);
+
+  /* One byte more than expected, so that the end of the file fits too. */
+  if (fstat(fileno(fp), &st) == 0 && S_ISREG(st.st_mode) && position >= 0 && position <= st.st_size) {
+    uint64 expect = st.st_size - position < limit ? st.st_size - position : limit;
+
+    matrix_reserve(matrix, total + expect + 1);
+  }
+
+  matrix_resize(matrix, total);
+
+  while (limit > 0) {
+    matrix_reserve(matrix, total + 1);
+
+    uint64 room  = matrix->capacity - total < limit ? matrix->capacity - total : limit;
+    uint64 count = fread(matrix->data + total, 1, room, fp);
+
+    if (count == 0)
+      break;
+
+    total += count;
+    limit -= count;
+
+    matrix->length = total;
   }
+
+  matrix_resize(matrix, total);
+
+  STATS_END(STATS_READ, read_time, total - initial);
+
+  return total;
 }
 
-char* safe_strdup(char const* str)
+/* Encipher or decipher between two regular files through memory mappings,
+ * from the current position of the input to the current position of the
+ * output, straight from the source pages to the destination pages.
+ *   @return The number of bytes read, or -1 if either file cannot be mapped,
+ *           in which case nothing has been consumed and the caller streams.
+ */
+sint64 map_blocks(FILE*         input_fp,
+                  FILE*         output_fp,
+                  zigma_t*      ziggy,
+                  checkpoint_t* index,
+                  zigma_cb_t*   callback,
+                  zigma_copy_t* copy,
+                  uint64        lead,
+                  uint64        limit)
 {
-  DEBUG_ASSERT(str != NULL);
+  int         input_fd  = fileno(input_fp);
+  int         output_fd = fileno(output_fp);
+  struct stat input_st;
+  struct stat output_st;
+
+  if (fflush(output_fp) != 0 || fstat(input_fd, &input_st) != 0 || fstat(output_fd, &output_st) != 0)
+    return -1;
+
+  if (!S_ISREG(input_st.st_mode) || !S_ISREG(output_st.st_mode))
+    return -1;
+
+  /* Both streams are unbuffered at this point, so the descriptors know where they are. */
+  off_t input_pos  = lseek(input_fd, 0, SEEK_CUR);
+  off_t output_pos = lseek(output_fd, 0, SEEK_CUR);
+
+  if (input_pos < 0 || output_pos < 0 || input_pos > input_st.st_size)
+    return -1;
+
+  uint64 size = input_st.st_size - input_pos;
+
+  size = size < limit ? size : limit;
+  lead = lead < size ? lead : size;
+
+  if (size == 0)
+    return 0;
+
+  uint64 input_end  = input_pos + size;
+  uint64 output_end = output_pos + size - lead;
+  uint8* source     = mmap(NULL, input_end, PROT_READ, MAP_PRIVATE, input_fd, 0);
+
+  if (source == MAP_FAILED)
+    return -1;
+
+  madvise(source, input_end, MADV_SEQUENTIAL);
+
+  /* Size the output up front; running out of space must not end in SIGBUS. */
+  if ((uint64) output_st.st_size < output_end && ftruncate(output_fd, output_end) != 0) {
+    fprintf(stderr, "ERROR: ftruncate(): unable to extend output to %llu bytes: %s\n", output_end, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  int error = posix_fallocate(output_fd, output_pos, output_end - output_pos);
+
+  if (error == ENOSPC || error == EFBIG) {
+    fprintf(stderr, "ERROR: posix_fallocate(): unable to reserve %llu bytes: %s\n", output_end, strerror(error));
+    exit(EXIT_FAILURE);
+  }
+
+  uint8* target = NULL;
+
+  if (output_end > (uint64) output_pos)
+    target = mmap(NULL, output_end, PROT_READ | PROT_WRITE, MAP_SHARED, output_fd, 0);
+
+  if (target == MAP_FAILED) {
+    munmap(source, input_end);
+    return -1;
+  }
+
+  if (target != NULL)
+    madvise(target, output_end, MADV_SEQUENTIAL);
 
-  size_t len  = strlen(str) + 1;
-  char*  copy = malloc(len);
+  fprintf(stderr, "Mapped %llu bytes of input and %llu bytes of output\n", size, output_end - output_pos);
 
-  DEBUG_ASSERT(copy != NULL);
+  uint8* from = source + input_pos;
+  uint8* to   = target + output_pos;
+  uint8  scratch[64 * 1024];
 
-  strncpy(copy, str, len); /*  NOLINT */
+  /* Reading and writing happen in page faults along the way. */
+  STATS_BEGIN(cipher_time);
 
-  copy[len] = '\0';
+  /* Bytes in front of skip only advance the state. */
+  while (lead > 0) {
+    uint32 step = lead < sizeof(scratch) ? lead : sizeof(scratch);
 
-  return copy;
+    copy(ziggy, from, scratch, step);
+
+    from += step;
+    lead -= step;
+  }
+
+  memnull(scratch, sizeof(scratch));
+
+  while (from < source + input_end) {
+    uint64 left = source + input_end - from;
+    uint32 step = left < (1U << 30) ? left : (1U << 30);
+
+    /* Checkpoints snapshot the state mid-buffer, which needs the in-place path. */
+    if (index != NULL) {
+      memcpy(to, from, step);
+      checkpoint_process(index, ziggy, to, step, callback);
+    }
+    else {
+      copy(ziggy, from, to, step);
+    }
+
+    from += step;
+    to += step;
+  }
+
+  STATS_END(STATS_CIPHER, cipher_time, size);
+
+  munmap(source, input_end);
+
+  if (target != NULL && munmap(target, output_end) != 0) {
+    fprintf(stderr, "ERROR: munmap(): unable to write output: %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  fseeko(input_fp, input_end, SEEK_SET);
+  fseeko(output_fp, output_end, SEEK_SET);
+
+  return size;
 }
 
-void memnull(void* ptr, uint32 size)
+/* Encipher or decipher every file under the if= directory into the same tree
+ * under of=. The key has been expanded once into ziggy, and every file starts
+ * from a copy of it. Files are spread over the threads of a pool, and with
+ * seg= the segments of every file are too.
+ */
+void handle_tree(kvlist_t** head, zigma_t const* ziggy, int inverse)
 {
-  volatile unsigned char* _ptr = ptr;
+  kvlist_t* input   = kvlist_search(head, "if");
+  kvlist_t* output  = kvlist_search(head, "of");
+  kvlist_t* fmt     = kvlist_search(head, "fmt");
+  kvlist_t* seg     = kvlist_search(head, "seg");
+  kvlist_t* threads = kvlist_search(head, "threads");
+  kvlist_t* idx     = kvlist_search(head, "idx");
+  kvlist_t* win     = kvlist_search(head, "win");
 
-  while (size--)
-    *_ptr++ = 0;
+  DEBUG_ASSERT(input != NULL);
+  DEBUG_ASSERT(output != NULL);
+  DEBUG_ASSERT(fmt != NULL);
+  DEBUG_ASSERT(seg != NULL);
+  DEBUG_ASSERT(threads != NULL);
+  DEBUG_ASSERT(idx != NULL);
+  DEBUG_ASSERT(win != NULL);
+
+  tree_job_t job = {
+      .base        = ziggy,
+      .inverse     = inverse,
+      .output_base = strtoul(fmt->value, 0, 10),
+  };
+  span_t span;
+  uint64 segment_size = inverse ? 0 : str2bytes(seg->value);
+  uint64 window       = inverse ? 0 : str2bytes(win->value);
+
+  parse_span(head, &span);
+
+  if (span.skip != 0 || span.seek != 0 || span.count != (uint64) -1 || *idx->value != 0)
+    fprintf(stderr, "WARNING: trees are processed file by file, ignoring skip=, seek=, count= and idx=\n");
+
+  if (segment_size > 0xFFFFFFFF) {
+    fprintf(stderr, "ERROR: invalid segment size 'seg=%s'\n", seg->value);
+    exit(EXIT_FAILURE);
+  }
+
+  /* Only raw containers are recognized when deciphering. */
+  if (segment_size != 0 && job.output_base != 256) {
+    fprintf(stderr, "WARNING: segmented files are raw, ignoring 'seg=%s' for 'fmt=%d'\n", seg->value, job.output_base);
+    segment_size = 0;
+  }
+
+  if (window != 0 && segment_size != 0) {
+    fprintf(stderr, "WARNING: segments are not shuffled, ignoring 'win=%s'\n", win->value);
+    window = 0;
+  }
+
+  job.segment_size = segment_size;
+  job.window       = window != 0 ? window_plan(window < WINDOW_MAX ? window : WINDOW_MAX) : 0;
+
+  tree_t tree = {
+      .pool = pool_create(strtoul(threads->value, 0, 10)),
+      .file = tree_file,
+      .arg  = &job,
+  };
+
+  fprintf(stderr, "%s the tree '%s' into '%s' on %u threads\n", inverse ? "Deciphering" : "Enciphering", input->value, output->value,
+          tree.pool->threads + 1);
+
+  tree_walk(&tree, input->value, output->value);
+  pool_destroy(tree.pool);
+
+  fprintf(stderr, "Complete! Total of %llu bytes read in %llu files and %llu directories\n", (uint64) atomic_load(&tree.bytes),
+          (uint64) atomic_load(&tree.files), (uint64) atomic_load(&tree.directories));
+
+  if (atomic_load(&tree.failures) != 0) {
+    fprintf(stderr, "ERROR: %llu files or directories failed\n", (uint64) atomic_load(&tree.failures));
+    exit(EXIT_FAILURE);
+  }
 }
 
 int parse_command(kvlist_t** head, int argc, char const* argv[])
@@ -238,6 +629,14 @@ int parse_command(kvlist_t** head, int argc, char const* argv[])
     case 'R':
       command = MODE_RANDOM;
       break;
+    case 't':
+    case 'T':
+      command = MODE_SELFTEST;
+      break;
+    case 's':
+    case 'S':
+      command = MODE_SERVE;
+      break;
     default:
       command = MODE_NONE;
       break;
@@ -247,21 +646,42 @@ int parse_command(kvlist_t** head, int argc, char const* argv[])
 
 void handle_cipher(kvlist_t** head)
 {
-  kvlist_t* input  = kvlist_search(head, "if");
-  kvlist_t* output = kvlist_search(head, "of");
-  kvlist_t* key    = kvlist_search(head, "key");
-  kvlist_t* fmt    = kvlist_search(head, "fmt");
+  kvlist_t* input     = kvlist_search(head, "if");
+  kvlist_t* output    = kvlist_search(head, "of");
+  kvlist_t* key       = kvlist_search(head, "key");
+  kvlist_t* fmt       = kvlist_search(head, "fmt");
+  kvlist_t* seg       = kvlist_search(head, "seg");
+  kvlist_t* threads   = kvlist_search(head, "threads");
+  kvlist_t* idx       = kvlist_search(head, "idx");
+  kvlist_t* ckpt_size = kvlist_search(head, "ckpt");
+  kvlist_t* io        = kvlist_search(head, "io");
+  kvlist_t* win       = kvlist_search(head, "win");
 
   DEBUG_ASSERT(input != NULL);
   DEBUG_ASSERT(output != NULL);
   DEBUG_ASSERT(key != NULL);
   DEBUG_ASSERT(fmt != NULL);
-
-  FILE* input_fp  = stdin;
-  FILE* output_fp = stdout;
+  DEBUG_ASSERT(seg != NULL);
+  DEBUG_ASSERT(threads != NULL);
+  DEBUG_ASSERT(idx != NULL);
+  DEBUG_ASSERT(ckpt_size != NULL);
+  DEBUG_ASSERT(io != NULL);
+  DEBUG_ASSERT(win != NULL);
+
+  FILE*       input_fp  = stdin;
+  FILE*       output_fp = stdout;
+  struct stat input_st;
+
+  /* A directory as input makes a tree of the output. */
+  int tree = *input->value != 0 && stat(input->value, &input_st) == 0 && S_ISDIR(input_st.st_mode);
+
+  if (tree && *output->value == 0) {
+    fprintf(stderr, "ERROR: the input '%s' is a directory, an output directory 'of=DIR' is needed\n", input->value);
+    exit(EXIT_FAILURE);
+  }
 
   /* Setup the input. */
-  if (*input->value != 0) {
+  if (*input->value != 0 && !tree) {
     input_fp = fopen(input->value, "r");
 
     if (input_fp == NULL) {
@@ -272,9 +692,9 @@ void handle_cipher(kvlist_t** head)
     fprintf(stderr, "Successfully opened input file '%s' for reading!\n", input->value);
   }
 
-  /* Setup the output. */
-  if (*output->value != 0) {
-    output_fp = fopen(output->value, "w");
+  /* Setup the output (readable too, so that it can be mapped). */
+  if (*output->value != 0 && !tree) {
+    output_fp = fopen(output->value, "w+");
 
     if (output_fp == NULL) {
       fprintf(stderr, "ERROR: fopen(): unable to open output file '%s': %s!\n", output->value, strerror(errno));
@@ -284,31 +704,15 @@ void handle_cipher(kvlist_t** head)
     fprintf(stderr, "Successfully opened output file '%s' for writing!\n", output->value);
   }
 
-  /* Setup key / passphrase. */
-  uint8  passkey[256]       = {0};
-  uint8  passkey_retry[256] = {0};
-  uint32 keylen             = 0;
-  uint32 keylen_retry       = 0;
+  /* Setup key / passphrase, in locked memory. */
+  uint8* passkey       = secure_alloc(256);
+  uint8* passkey_retry = secure_alloc(256);
+  uint32 keylen        = 0;
+  uint32 keylen_retry  = 0;
 
   /* Read the key from a file. */
   if (*key->value != 0) {
-    FILE* key_fp = fopen(key->value, "r");
-
-    if (key_fp == NULL) {
-      fprintf(stderr, "ERROR: fopen(): unable to open key file '%s': %s!\n", key->value, strerror(errno));
-      exit(EXIT_FAILURE);
-    }
-
-    keylen = fread(passkey, 1, 256, key_fp);
-
-    if (keylen == 0) {
-      fprintf(stderr, "ERROR: fread(): unable to read key file '%s': %s!\n", key->value, strerror(errno));
-      exit(EXIT_FAILURE);
-    }
-
-    fprintf(stderr, "Read %u bytes from key file '%s'!\n", keylen, key->value);
-
-    fclose(key_fp);
+    keylen = read_keyfile(key->value, passkey);
   }
   /* Read the key from the user. */
   else {
@@ -318,8 +722,8 @@ void handle_cipher(kvlist_t** head)
     if (keylen != keylen_retry || strcmp((char*) passkey, (char*) passkey_retry) != 0) {
       fprintf(stderr, "PASSWORD MISMATCH!\n");
 
-      memnull(passkey, 256);
-      memnull(passkey_retry, 256);
+      secure_free(passkey, 256);
+      secure_free(passkey_retry, 256);
 
       fclose(input_fp);
       fclose(output_fp);
@@ -328,89 +732,263 @@ void handle_cipher(kvlist_t** head)
     }
   }
 
-  zigma_t*  ziggy  = zigma_init(NULL, passkey, keylen);
-  matrix_t* matrix = matrix_init(NULL, 0);
+  STATS_BEGIN(key_time);
+
+  zigma_t* ziggy = zigma_init(NULL, passkey, keylen);
+
+  STATS_END(STATS_KEY, key_time, keylen);
 
   zigma_print(ziggy);
 
   /* Purge passphrase from memory */
-  memnull(passkey, 256);
-  memnull(passkey_retry, 256);
+  secure_free(passkey, 256);
+  secure_free(passkey_retry, 256);
 
-  zigma_cb_t* zigma_callback = zigma_encrypt;
+  if (tree) {
+    handle_tree(head, ziggy, 0);
+    zigma_destroy(ziggy);
+    return;
+  }
 
-  uint8  buffer[768];
-  uint32 total = 0;
-  uint32 count;
+  matrix_t* matrix = matrix_init(NULL, 0);
 
-  int output_base = strtoul(fmt->value, 0, 10);
+  zigma_cb_t*   zigma_callback = zigma_encrypt;
+  zigma_copy_t* zigma_copy     = zigma_encrypt_copy;
 
-  if (output_base == 64)
-    fprintf(output_fp, "##### BEGIN BASE64 #####\n");
-  else if (output_base == 16)
-    fprintf(output_fp, "##### BEGIN BASE16 #####\n");
+  span_t span;
+  uint64 total = 0;
 
-  while ((count = fread(buffer, 1, 768, input_fp)) > 0) {
-    matrix_resize(matrix, count + total);
-    memcpy(matrix->data + total, buffer, count);
+  parse_span(head, &span);
 
-    total += count;
+  if (!skip_input(input_fp, span.skip)) {
+    fprintf(stderr, "ERROR: unable to skip %llu bytes of input\n", span.skip);
+    exit(EXIT_FAILURE);
   }
 
-  matrix_print(matrix);
+  seek_output(output_fp, span.seek);
+
+  int     output_base  = strtoul(fmt->value, 0, 10);
+  uint64  segment_size = str2bytes(seg->value);
+  uint64  window       = str2bytes(win->value);
+  codec_t codec;
+
+  /* The container records the segment size in 32 bits. */
+  if (segment_size > 0xFFFFFFFF) {
+    fprintf(stderr, "ERROR: invalid segment size 'seg=%s'\n", seg->value);
+    exit(EXIT_FAILURE);
+  }
+
+  if (window != 0 && segment_size != 0) {
+    fprintf(stderr, "WARNING: segments are not shuffled, ignoring 'win=%s'\n", win->value);
+    window = 0;
+  }
+  else if (window != 0) {
+    window = window_plan(window < WINDOW_MAX ? window : WINDOW_MAX);
+
+    fprintf(stderr, "Shuffling the cryptogram in windows of %llu bytes\n", window);
+  }
+
+  /* Record checkpoints of the continuous stream. */
+  checkpoint_t  ckpt;
+  checkpoint_t* index  = NULL;
+  FILE*         idx_fp = NULL;
 
-  zigma_callback(ziggy, matrix->data, total);
+  if (*idx->value != 0 && segment_size != 0) {
+    fprintf(stderr, "WARNING: segments are independent, not writing index file '%s'\n", idx->value);
+  }
+  else if (*idx->value != 0 && window != 0) {
+    fprintf(stderr, "WARNING: shuffled cryptograms cannot resume from checkpoints, not writing index file '%s'\n", idx->value);
+  }
+  else if (*idx->value != 0) {
+    uint64 interval = str2bytes(ckpt_size->value);
+
+    idx_fp = fopen(idx->value, "w");
+
+    if (idx_fp == NULL) {
+      fprintf(stderr, "ERROR: fopen(): unable to open index file '%s': %s!\n", idx->value, strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+
+    index = checkpoint_create(&ckpt, idx_fp, ziggy, interval != 0 ? interval : CHECKPOINT_INTERVAL);
+  }
 
-  if (output_base == 256) {
-    fwrite(matrix->data, 1, total, output_fp);
+  codec_begin(&codec, output_fp, output_base);
+
+  /* The window size goes in front of the shuffled cryptogram. */
+  if (window != 0) {
+    uint8 header[WINDOW_HEADER_SIZE];
+
+    window_write_header(window, header);
+    codec_write(&codec, header, WINDOW_HEADER_SIZE);
   }
-  else if (output_base == 16) {
-    for (int i = 0; i < total; i++) {
-      fprintf(output_fp, "%02X", (unsigned char) buffer[i]);
+
+  if (segment_size == 0 && strcmp(io->value, "stream") == 0) {
+    sint64 mapped = -1;
+
+    /* Raw output between regular files goes through memory mappings. */
+    if (output_base == 256 && window == 0)
+      mapped = map_blocks(input_fp, output_fp, ziggy, index, zigma_callback, zigma_copy, 0, span.count);
+
+    if (mapped >= 0) {
+      total = mapped;
+    }
+    else {
+      stream_t stream = {
+          .input_fp = input_fp,
+          .limit    = span.count,
+          .ziggy    = ziggy,
+          .index    = index,
+          .callback = zigma_callback,
+          .window   = window,
+          .codec    = &codec,
+          .count    = (uint64) -1,
+      };
+
+      total = stream_blocks(&stream);
+
+      if (stream_report(&stream, NULL))
+        exit(EXIT_FAILURE);
     }
   }
-  else if (output_base == 64) {
-    char* encoded = malloc(total * 2);
-    base64_encode(encoded, (char*) matrix->data, total);
+  else {
+    total = read_input(input_fp, matrix, 0, span.count);
+
+    matrix_print(matrix);
 
-    for (int i = 0; i < total; i++) {
-      fprintf(output_fp, "%c", encoded[i]);
+    STATS_BEGIN(cipher_time);
 
-      if ((i + 1) % 80 == 0)
-        fprintf(output_fp, "\n");
+    if (segment_size != 0) {
+      segment_header_t header;
+      pool_t*          pool = pool_create(strtoul(threads->value, 0, 10));
+
+      if ((total + segment_size - 1) / segment_size > 0xFFFFFFFF) {
+        fprintf(stderr, "ERROR: too many segments, use a larger 'seg=%s'\n", seg->value);
+        exit(EXIT_FAILURE);
+      }
+
+      segment_plan(&header, segment_size, total);
+
+      fprintf(stderr, "Enciphering %u segments of %u bytes on %u threads\n", header.segment_count, header.segment_size, pool->threads + 1);
+
+      /* Make room for the container header in front of the payload. */
+      matrix_resize(matrix, total + SEGMENT_HEADER_SIZE);
+      memmove(matrix->data + SEGMENT_HEADER_SIZE, matrix->data, total);
+
+      segment_encrypt(pool, ziggy, &header, matrix->data + SEGMENT_HEADER_SIZE);
+      segment_write_header(&header, matrix->data);
+
+      total += SEGMENT_HEADER_SIZE;
+
+      pool_destroy(pool);
+    }
+    else if (index != NULL) {
+      checkpoint_process(index, ziggy, matrix->data, total, zigma_callback);
+    }
+    else {
+      zigma_callback(ziggy, matrix->data, total);
     }
 
-    free(encoded);
+    if (window != 0)
+      window_shuffle(matrix->data, total, matrix->capacity, window);
 
-    fflush(output_fp);
+    STATS_END(STATS_CIPHER, cipher_time, total);
+    STATS_BEGIN(codec_time);
 
-    if (output_base == 64)
-      fprintf(output_fp, "\n##### END BASE64 #####\n");
-    else if (output_base == 16)
-      fprintf(output_fp, "\n##### END BASE16 #####\n");
+    codec_write(&codec, matrix->data, total);
 
-    fprintf(stderr, "Complete! Total of %u bytes read/written\n", total);
-    fclose(output_fp);
+    STATS_END(output_base == 256 ? STATS_WRITE : STATS_CODEC, codec_time, total);
+  }
+
+  STATS_BEGIN(write_time);
+
+  codec_end(&codec);
+
+  STATS_END(STATS_WRITE, write_time, 0);
+
+  if (index != NULL) {
+    fprintf(stderr, "Wrote %llu checkpoints to index file '%s'\n", index->count, idx->value);
+
+    if (!checkpoint_finish(index) || fclose(idx_fp) != 0) {
+      fprintf(stderr, "ERROR: unable to write index file '%s': %s!\n", idx->value, strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  fprintf(stderr, "Complete! Total of %llu bytes read/written\n", total);
+  fclose(output_fp);
+
+  zigma_destroy(ziggy);
+  matrix_destroy(matrix);
+}
+
+/* Decipher a whole segmented container in a matrix, in parallel, leaving the
+ * plaintext at the start of the matrix.
+ *   @return The length of the plaintext.
+ */
+uint64 decipher_segments(kvlist_t** head, zigma_t const* ziggy, matrix_t* matrix, uint64 total)
+{
+  kvlist_t*        threads = kvlist_search(head, "threads");
+  segment_header_t header;
+
+  DEBUG_ASSERT(threads != NULL);
+
+  if (!segment_read_header(&header, matrix->data, total) || header.length != total - SEGMENT_HEADER_SIZE) {
+    fprintf(stderr, "ERROR: the segmented cryptogram is truncated or its header is damaged\n");
+    exit(EXIT_FAILURE);
   }
+
+  pool_t* pool = pool_create(strtoul(threads->value, 0, 10));
+
+  fprintf(stderr, "Deciphering %u segments of %u bytes on %u threads\n", header.segment_count, header.segment_size, pool->threads + 1);
+
+  STATS_BEGIN(cipher_time);
+
+  segment_decrypt(pool, ziggy, &header, matrix->data + SEGMENT_HEADER_SIZE);
+  memmove(matrix->data, matrix->data + SEGMENT_HEADER_SIZE, header.length);
+
+  STATS_END(STATS_CIPHER, cipher_time, header.length);
+
+  pool_destroy(pool);
+
+  return header.length;
 }
 
 void handle_decipher(kvlist_t** head)
 {
-  kvlist_t* input  = kvlist_search(head, "if");
-  kvlist_t* output = kvlist_search(head, "of");
-  kvlist_t* key    = kvlist_search(head, "key");
-  kvlist_t* fmt    = kvlist_search(head, "fmt");
+  kvlist_t* input     = kvlist_search(head, "if");
+  kvlist_t* output    = kvlist_search(head, "of");
+  kvlist_t* key       = kvlist_search(head, "key");
+  kvlist_t* fmt       = kvlist_search(head, "fmt");
+  kvlist_t* seg       = kvlist_search(head, "seg");
+  kvlist_t* threads   = kvlist_search(head, "threads");
+  kvlist_t* idx       = kvlist_search(head, "idx");
+  kvlist_t* ckpt_size = kvlist_search(head, "ckpt");
+  kvlist_t* io        = kvlist_search(head, "io");
 
   DEBUG_ASSERT(input != NULL);
   DEBUG_ASSERT(output != NULL);
   DEBUG_ASSERT(key != NULL);
   DEBUG_ASSERT(fmt != NULL);
-
-  FILE* input_fp  = stdin;
-  FILE* output_fp = stdout;
+  DEBUG_ASSERT(seg != NULL);
+  DEBUG_ASSERT(threads != NULL);
+  DEBUG_ASSERT(idx != NULL);
+  DEBUG_ASSERT(ckpt_size != NULL);
+  DEBUG_ASSERT(io != NULL);
+
+  FILE*       input_fp  = stdin;
+  FILE*       output_fp = stdout;
+  struct stat input_st;
+
+  /* A directory as input makes a tree of the output. */
+  int tree = *input->value != 0 && stat(input->value, &input_st) == 0 && S_ISDIR(input_st.st_mode);
+
+  if (tree && *output->value == 0) {
+    fprintf(stderr, "ERROR: the input '%s' is a directory, an output directory 'of=DIR' is needed\n", input->value);
+    exit(EXIT_FAILURE);
+  }
 
   /* Setup the input. */
-  if (*input->value != 0) {
+  if (*input->value != 0 && !tree) {
     input_fp = fopen(input->value, "r");
 
     if (input_fp == NULL) {
@@ -421,9 +999,9 @@ void handle_decipher(kvlist_t** head)
     fprintf(stderr, "Successfully opened input file '%s' for reading!\n", input->value);
   }
 
-  /* Setup the output. */
-  if (*output->value != 0) {
-    output_fp = fopen(output->value, "w");
+  /* Setup the output (readable too, so that it can be mapped). */
+  if (*output->value != 0 && !tree) {
+    output_fp = fopen(output->value, "w+");
 
     if (output_fp == NULL) {
       fprintf(stderr, "ERROR: fopen(): unable to open output file '%s': %s!\n", output->value, strerror(errno));
@@ -433,34 +1011,33 @@ void handle_decipher(kvlist_t** head)
     fprintf(stderr, "Successfully opened output file '%s' for writing!\n", output->value);
   }
 
-  /* Setup the key / passphrase */
-  uint8  passkey[256] = {0};
-  uint32 keylen       = 0;
+  /* Setup the key / passphrase, in locked memory */
+  uint8* passkey = secure_alloc(256);
+  uint32 keylen  = 0;
 
   /* Read the key from a file. */
   if (*key->value != 0) {
-    FILE* key_fp = fopen(key->value, "r");
+    keylen = read_keyfile(key->value, passkey);
+  }
+  else {
+    keylen = get_passwd(passkey, (uint8*) "enter passphrase: ");
+  }
 
-    if (key_fp == NULL) {
-      fprintf(stderr, "ERROR: fopen(): unable to open key file '%s': %s!\n", key->value, strerror(errno));
-      exit(EXIT_FAILURE);
-    }
+  STATS_BEGIN(key_time);
 
-    keylen = fread(passkey, 1, 256, key_fp);
+  zigma_t* ziggy = zigma_init(NULL, passkey, keylen);
 
-    if (keylen == 0) {
-      fprintf(stderr, "ERROR: fread(): unable to read key file '%s': %s!\n", key->value, strerror(errno));
-      exit(EXIT_FAILURE);
-    }
-    fprintf(stderr, "Read %u bytes from key file '%s'!\n", keylen, key->value);
+  STATS_END(STATS_KEY, key_time, keylen);
 
-    fclose(key_fp);
-  }
-  else {
-    keylen = get_passwd(passkey, (uint8*) "enter passphrase: ");
+  secure_free(passkey, 256);
+
+  if (tree) {
+    zigma_print(ziggy);
+    handle_tree(head, ziggy, 1);
+    zigma_destroy(ziggy);
+    return;
   }
 
-  zigma_t*  ziggy  = zigma_init(NULL, passkey, keylen);
   matrix_t* matrix = matrix_init(NULL, 0);
 
   zigma_cb_t* poem_callback = zigma_decrypt;
@@ -468,72 +1045,809 @@ void handle_decipher(kvlist_t** head)
   zigma_print(ziggy);
   matrix_print(matrix);
 
-  uint8  buffer[768];
-  uint32 total = 0;
-  uint32 count;
+  span_t span;
+  uint64 position = 0;
+  uint64 total    = 0;
 
-  int output_base = strtoul(fmt->value, 0, 10);
+  parse_span(head, &span);
 
-  while ((count = fread(buffer, 1, 768, input_fp)) > 0) {
-    matrix_resize(matrix, count + total);
-    memcpy(matrix->data + total, buffer, count);
+  /* Look at the start of the input to recognize its format. */
+  uint8  peek[CODEC_DETECT];
+  uint32 peeked = 0;
 
-    total += count;
-  }
+  while (peeked < sizeof(peek)) {
+    uint32 count = read_block(input_fp, peek + peeked, sizeof(peek) - peeked);
 
-  poem_callback(ziggy, matrix->data, total);
+    if (count == 0)
+      break;
 
-  if (output_base == 256) {
-    fwrite(matrix->data, 1, total, output_fp);
+    peeked += count;
   }
 
-  fprintf(stderr, "Complete! Total of %u bytes read/written\n", total);
-}
-
-void handle_checksum(kvlist_t** head)
-{
-  kvlist_t* input = kvlist_search(head, "if");
+  int base      = codec_detect(peek, peeked);
+  int segmented = base == 256 && peeked >= SEGMENT_HEADER_SIZE && memcmp(peek, SEGMENT_MAGIC, 8) == 0;
+  int windowed  = base == 256 && peeked >= WINDOW_HEADER_SIZE && memcmp(peek, WINDOW_MAGIC, 8) == 0;
 
-  DEBUG_ASSERT(input != NULL);
+  if (base != 256)
+    fprintf(stderr, "Reading base%d armored input\n", base);
 
-  zigma_t* poem = zigma_init(NULL, NULL, 0);
+  /* Start from the nearest checkpoint instead of the first byte. */
+  if (span.skip != 0 && *idx->value != 0 && (base != 256 || segmented || windowed)) {
+    fprintf(stderr, "WARNING: checkpoints only apply to raw streams, not using index file '%s'\n", idx->value);
+  }
+  else if (span.skip != 0 && *idx->value != 0) {
+    checkpoint_t ckpt;
+    FILE*        idx_fp = fopen(idx->value, "r");
+    sint64       found  = -1;
 
-  zigma_print(poem);
+    if (idx_fp == NULL) {
+      fprintf(stderr, "ERROR: fopen(): unable to open index file '%s': %s!\n", idx->value, strerror(errno));
+      exit(EXIT_FAILURE);
+    }
 
-  FILE* input_fp = stdin;
+    if (checkpoint_open(&ckpt, idx_fp, ziggy)) {
+      found = checkpoint_seek(&ckpt, ziggy, span.skip);
+      checkpoint_close(&ckpt);
+    }
 
-  /* Setup the input. */
-  if (*input->value != 0) {
-    input_fp = fopen(input->value, "r");
+    fclose(idx_fp);
 
-    if (input_fp == NULL) {
-      fprintf(stderr, "ERROR: fopen(): unable to open input file '%s': %s\n", input->value, strerror(errno));
+    if (found < 0) {
+      fprintf(stderr, "ERROR: index file '%s' is damaged or belongs to another key!\n", idx->value);
       exit(EXIT_FAILURE);
     }
 
-    fprintf(stderr, "Successfully opened input file '%s' for reading!\n", input->value);
+    position = (uint64) found;
+
+    fprintf(stderr, "Resuming from checkpoint at byte %llu\n", position);
   }
 
-  zigma_cb_t* zigma_callback = zigma_encrypt;
+  /* Whatever was peeked at past the checkpoint is still to be deciphered. */
+  if (position < peeked) {
+    memmove(peek, peek + position, peeked - position);
+    peeked -= position;
+  }
+  else if (!skip_input(input_fp, position - peeked)) {
+    fprintf(stderr, "ERROR: unable to skip %llu bytes of input\n", position);
+    exit(EXIT_FAILURE);
+  }
+  else {
+    peeked = 0;
+  }
 
-  uint8  buffer[1024] = {0};
-  uint32 total        = 0;
-  uint32 count;
+  seek_output(output_fp, span.seek);
+
+  /* Everything between the checkpoint and skip is deciphered and dropped. A
+   * raw stream need not be read past skip + count.
+   */
+  uint64    lead  = span.skip - position;
+  uint64    limit = base == 256 && !segmented && !windowed && span.count != (uint64) -1 ? lead + span.count : (uint64) -1;
+  codec_t   codec;
+  decoder_t decoder;
+  uint32    window = 0;
+  stream_t  stream = {
+       .input_fp       = input_fp,
+       .limit          = limit > peeked ? limit - peeked : 0,
+       .pending        = peek,
+       .pending_length = peeked,
+       .ziggy          = ziggy,
+       .callback       = poem_callback,
+       .inverse        = 1,
+       .codec          = &codec,
+       .lead           = lead,
+       .count          = span.count,
+  };
+
+  codec_begin(&codec, output_fp, 256);
+
+  if (base != 256) {
+    decoder_begin(&decoder, base);
+    stream.decoder = &decoder;
+  }
 
-  while ((count = fread(buffer, 1, 1024, input_fp)) > 0) {
-    total += count;
-    zigma_callback(poem, buffer, count);
+  if (!segmented && strcmp(io->value, "stream") == 0) {
+    /* Only the start of a cryptogram can hold a window header, or the header
+     * of an armored segmented container.
+     */
+    if (position == 0)
+      total = stream_begin(&stream, matrix);
+
+    if (matrix->length != 0)
+      total = stream_gather(&stream, matrix, matrix->length);
+
+    if (stream_report(&stream, NULL))
+      exit(EXIT_FAILURE);
+
+    if (matrix->length != 0) {
+      total = decipher_segments(head, ziggy, matrix, total);
+
+      stream_write(&stream, matrix->data, total);
+    }
+    else if (stream.window != 0) {
+      fprintf(stderr, "Unshuffling windows of %u bytes\n", stream.window);
+
+      total += stream_blocks(&stream);
+    }
+    else {
+      sint64 mapped = -1;
+
+      /* A raw cryptogram in a regular file goes through memory mappings, once
+       * the bytes peeked at are out of the way.
+       */
+      if (base == 256) {
+        total += stream.pending_length;
+
+        stream_write(&stream, stream.pending, stream_work(&stream, stream.pending, stream.pending_length));
+        stream.pending_length = 0;
+
+        mapped = map_blocks(input_fp, output_fp, ziggy, NULL, poem_callback, zigma_decrypt_copy, stream.lead, stream.limit);
+      }
+
+      if (mapped >= 0)
+        total += mapped;
+      else
+        total += stream_blocks(&stream);
+    }
+
+    if (stream_report(&stream, NULL))
+      exit(EXIT_FAILURE);
+  }
+  else {
+    matrix_resize(matrix, peeked);
+    memcpy(matrix->data, peek, peeked);
+
+    total = read_input(input_fp, matrix, peeked, stream.limit);
+
+    if (stream.decoder != NULL)
+      total = stream_decode(&stream, matrix->data, total);
+
+    if (stream_report(&stream, NULL))
+      exit(EXIT_FAILURE);
+
+    if (position == 0 && window_read_header(&window, matrix->data, total)) {
+      fprintf(stderr, "Unshuffling windows of %u bytes\n", window);
+
+      total -= WINDOW_HEADER_SIZE;
+      memmove(matrix->data, matrix->data + WINDOW_HEADER_SIZE, total);
+
+      STATS_BEGIN(cipher_time);
+
+      window_unshuffle(matrix->data, total, matrix->capacity, window);
+      poem_callback(ziggy, matrix->data, total);
+
+      STATS_END(STATS_CIPHER, cipher_time, total);
+    }
+    else if (position == 0 && total >= 8 && memcmp(matrix->data, SEGMENT_MAGIC, 8) == 0) {
+      total = decipher_segments(head, ziggy, matrix, total);
+    }
+    else {
+      total = stream_work(&stream, matrix->data, total);
+    }
+
+    stream_write(&stream, matrix->data, total);
+  }
+
+  if (stream.decoder != NULL && !decoder_end(stream.decoder)) {
+    fprintf(stderr, "ERROR: the armored input is truncated\n");
+    exit(EXIT_FAILURE);
+  }
+
+  codec_end(&codec);
+
+  fprintf(stderr, "Complete! Total of %llu bytes read/written\n", total);
+  fclose(output_fp);
+
+  zigma_destroy(ziggy);
+  matrix_destroy(matrix);
+}
+
+/* Memory for the leaves of the tree hash that are in flight at once. */
+#define TREEHASH_BUDGET (256 * 1024 * 1024)
+
+/* Bytes of a leaf read at a time when leaves are streamed one by one. */
+#define TREEHASH_PIECE (4 * 1024 * 1024)
+
+/* A group of leaves too large to hold in memory, one per thread, each read and
+ * hashed piece by piece.
+ */
+typedef struct treehash_group_t {
+  FILE*  input_fp;
+  int    seekable;
+  uint64 start;
+  uint64 end;
+  uint64 leaf_size;
+  uint64 piece;
+  uint8* digests;
+} treehash_group_t;
+
+static void treehash_leaf(void* arg, uint32 index)
+{
+  treehash_group_t* group  = arg;
+  uint64            offset = group->start + (uint64) index * group->leaf_size;
+  uint64            left   = group->end - offset < group->leaf_size ? group->end - offset : group->leaf_size;
+  uint8*            piece  = (uint8*) malloc(group->piece);
+  zigma_t           leaf;
+
+  DEBUG_ASSERT(piece != NULL);
+
+  zigma_init_hash(&leaf);
+
+  while (left > 0) {
+    uint64 size = left < group->piece ? left : group->piece;
+    uint64 count;
+
+    STATS_BEGIN(read_time);
+
+    /* Regular files are read at the leaf's offset, anything else in order. */
+    if (group->seekable)
+      count = pread(fileno(group->input_fp), piece, size, (off_t) offset);
+    else
+      count = fread(piece, 1, size, group->input_fp);
+
+    STATS_END(STATS_READ, read_time, count);
+
+    if (count != size) {
+      fprintf(stderr, "ERROR: unable to read %llu bytes of input at %llu\n", size, offset);
+      exit(EXIT_FAILURE);
+    }
+
+    STATS_BEGIN(hash_time);
+
+    zigma_hash_update(&leaf, piece, size);
+
+    STATS_END(STATS_HASH, hash_time, size);
+
+    offset += size;
+    left -= size;
+  }
+
+  zigma_hash_sign(&leaf, group->digests + (uint64) index * ZIGMA_CHECKSUM_SIZE, ZIGMA_CHECKSUM_SIZE);
+
+  free(piece);
+}
+
+/* Hash leaves that do not fit into the budget a thread at a time: every
+ * thread streams a leaf of its own from a regular file, and the leaves of
+ * anything else are streamed one after the other.
+ *   @return The number of bytes hashed.
+ */
+uint64 treehash_stream(hashtree_t* tree, pool_t* pool, FILE* input_fp)
+{
+  struct stat      st;
+  uint32           threads = pool->threads + 1;
+  uint8            digest[ZIGMA_CHECKSUM_SIZE];
+  uint64           total   = 0;
+  off_t            start   = ftello(input_fp);
+  treehash_group_t group   = {
+        .input_fp  = input_fp,
+        .leaf_size = tree->leaf_size,
+        .piece     = TREEHASH_BUDGET / threads,
+  };
+
+  if (fstat(fileno(input_fp), &st) == 0 && S_ISREG(st.st_mode) && start >= 0) {
+    group.seekable = 1;
+    group.end      = st.st_size;
+    group.digests  = (uint8*) malloc((uint64) threads * ZIGMA_CHECKSUM_SIZE);
+
+    DEBUG_ASSERT(group.digests != NULL);
+
+    for (group.start = start; group.start < group.end; group.start += (uint64) threads * tree->leaf_size) {
+      uint64 left  = group.end - group.start;
+      uint64 count = (left + tree->leaf_size - 1) / tree->leaf_size;
+
+      count = count < threads ? count : threads;
+
+      pool_for(pool, (uint32) count, treehash_leaf, &group);
+
+      left = count * tree->leaf_size < left ? count * tree->leaf_size : left;
+      hashtree_absorb(tree, group.digests, (uint32) count, left);
+      total += left;
+    }
+
+    free(group.digests);
+
+    return total;
+  }
+
+  /* The length of a stream is known once it ends, so every leaf is read up
+   * to the end of the input and cut short there.
+   */
+  uint8* piece = (uint8*) malloc(TREEHASH_PIECE);
+
+  DEBUG_ASSERT(piece != NULL);
+
+  while (1) {
+    uint64  size = 0;
+    uint64  count;
+    zigma_t leaf;
+
+    zigma_init_hash(&leaf);
+
+    while (size < tree->leaf_size) {
+      uint64 want = tree->leaf_size - size < TREEHASH_PIECE ? tree->leaf_size - size : TREEHASH_PIECE;
+
+      STATS_BEGIN(read_time);
+
+      if ((count = fread(piece, 1, want, input_fp)) == 0)
+        break;
+
+      STATS_END(STATS_READ, read_time, count);
+      STATS_BEGIN(hash_time);
+
+      zigma_hash_update(&leaf, piece, count);
+      size += count;
+
+      STATS_END(STATS_HASH, hash_time, count);
+    }
+
+    if (size == 0)
+      break;
+
+    zigma_hash_sign(&leaf, digest, ZIGMA_CHECKSUM_SIZE);
+    hashtree_absorb(tree, digest, 1, size);
+    total += size;
+
+    if (size < tree->leaf_size)
+      break;
+  }
+
+  free(piece);
+
+  return total;
+}
+
+/* Hash the input as a tree of leaves, a few leaves per thread at a time, in
+ * no more than TREEHASH_BUDGET bytes of memory.
+ */
+void handle_treehash(kvlist_t* input, FILE* input_fp, uint64 leaf_size, uint32 threads)
+{
+  pool_t*    pool   = pool_create(threads);
+  uint64     leaves = 2 * (pool->threads + 1);
+  uint64     total  = 0;
+  uint64     count;
+  hashtree_t tree;
+
+  hashtree_init(&tree, leaf_size);
+
+  /* Two leaves per thread if they fit, or else at least one. */
+  if (leaf_size * leaves > TREEHASH_BUDGET)
+    leaves = TREEHASH_BUDGET / leaf_size;
+
+  if (leaves < pool->threads + 1) {
+    total = treehash_stream(&tree, pool, input_fp);
+  }
+  else {
+    uint64 batch = leaf_size * leaves;
+    uint8* block = malloc(batch);
+
+    if (block == NULL) {
+      fprintf(stderr, "ERROR: malloc(): unable to allocate %llu bytes for leaves\n", batch);
+      exit(EXIT_FAILURE);
+    }
+
+    /* Only a short read, at the end of the input, leaves a partial leaf. */
+    while (1) {
+      STATS_BEGIN(read_time);
+
+      if ((count = fread(block, 1, batch, input_fp)) == 0)
+        break;
+
+      STATS_END(STATS_READ, read_time, count);
+      STATS_BEGIN(hash_time);
+
+      hashtree_update(&tree, pool, block, count);
+      total += count;
+
+      STATS_END(STATS_HASH, hash_time, count);
+
+      if (count < batch)
+        break;
+    }
+
+    free(block);
   }
 
   uint8 checksum[32] = {0};
 
+  hashtree_final(&tree, checksum, 32);
+
+  /* The root is the result, so it goes to STDOUT. */
+  printf("%s (%llu bytes, %llu leaves of %llu): ", input->value, total, tree.leaves, leaf_size);
+  for (int j = 0; j < 24; j++)
+    printf("%02x", (unsigned char) checksum[j]);
+
+  printf("\n");
+
+  pool_destroy(pool);
+}
+
+/* Pick up the hash of an input from a state file, if there is one and the
+ * input still starts with the bytes it has seen, and position the input after
+ * them. The input must be a regular file.
+ *   @return The number of bytes skipped.
+ */
+uint64 hash_resume(char const* path, FILE* input_fp, zigma_t* poem)
+{
+  struct stat st;
+  hashstate_t saved;
+
+  if (fstat(fileno(input_fp), &st) != 0 || !S_ISREG(st.st_mode)) {
+    fprintf(stderr, "ERROR: hash_resume(): state= needs a regular input file\n");
+    exit(EXIT_FAILURE);
+  }
+
+  FILE* state_fp = fopen(path, "r");
+
+  /* There is nothing to resume from on the first run. */
+  if (state_fp == NULL) {
+    if (errno != ENOENT) {
+      fprintf(stderr, "ERROR: fopen(): unable to open state file '%s': %s\n", path, strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+
+    fprintf(stderr, "No state file '%s' yet, hashing from the start\n", path);
+    return 0;
+  }
+
+  uint64 offset = 0;
+
+  if (!hashstate_load(&saved, state_fp))
+    fprintf(stderr, "WARNING: hash_resume(): '%s' is not a hash state, hashing from the start\n", path);
+  else if (!hashstate_matches(&saved, fileno(input_fp)))
+    fprintf(stderr, "WARNING: hash_resume(): the input changed since '%s' was saved, hashing from the start\n", path);
+  else if (fseeko(input_fp, (off_t) saved.offset, SEEK_SET) != 0)
+    fprintf(stderr, "WARNING: fseeko(): unable to seek input to %llu: %s, hashing from the start\n", saved.offset, strerror(errno));
+  else {
+    zigma_clone(poem, &saved.state);
+    offset = saved.offset;
+
+    fprintf(stderr, "Resuming from state file '%s' after %llu bytes\n", path, offset);
+  }
+
+  fclose(state_fp);
+
+  return offset;
+}
+
+/* Save the hash of the first total bytes of the input to a state file. The
+ * state is written next to it and renamed over it, so an interrupted run
+ * leaves the previous state in place.
+ */
+void hash_save(char const* path, FILE* input_fp, zigma_t const* poem, uint64 total)
+{
+  hashstate_t current;
+  uint64      length    = strlen(path) + 5;
+  char*       temporary = (char*) malloc(length);
+
+  DEBUG_ASSERT(temporary != NULL);
+
+  snprintf(temporary, length, "%s.tmp", path);
+
+  if (!hashstate_capture(&current, poem, fileno(input_fp), total)) {
+    fprintf(stderr, "WARNING: hash_save(): unable to fingerprint the input, not saving '%s'\n", path);
+    free(temporary);
+    return;
+  }
+
+  FILE* state_fp = fopen(temporary, "w");
+
+  if (state_fp == NULL) {
+    fprintf(stderr, "ERROR: fopen(): unable to open state file '%s': %s\n", temporary, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  int status = hashstate_save(&current, state_fp);
+
+  if (fclose(state_fp) != 0 || !status || rename(temporary, path) != 0) {
+    fprintf(stderr, "ERROR: hash_save(): unable to write state file '%s': %s\n", path, strerror(errno));
+    unlink(temporary);
+    exit(EXIT_FAILURE);
+  }
+
+  fprintf(stderr, "Saved the state after %llu bytes to '%s'\n", total, path);
+
+  free(temporary);
+}
+
+/* Hash every file of a list, or verify a list of checksums, on a pool.
+ *   @return 0 if every file was read (and matched), 1 otherwise.
+ */
+int handle_manifest(kvlist_t** head)
+{
+  kvlist_t* sum     = kvlist_search(head, "sum");
+  kvlist_t* check   = kvlist_search(head, "check");
+  kvlist_t* output  = kvlist_search(head, "of");
+  kvlist_t* threads = kvlist_search(head, "threads");
+
+  DEBUG_ASSERT(sum != NULL);
+  DEBUG_ASSERT(check != NULL);
+  DEBUG_ASSERT(output != NULL);
+  DEBUG_ASSERT(threads != NULL);
+
+  if (*sum->value != 0 && *check->value != 0) {
+    fprintf(stderr, "ERROR: handle_manifest(): sum= and check= are mutually exclusive\n");
+    exit(EXIT_FAILURE);
+  }
+
+  char const* list    = *check->value != 0 ? check->value : sum->value;
+  FILE*       list_fp = stdin;
+
+  if (strcmp(list, "-") != 0 && (list_fp = fopen(list, "r")) == NULL) {
+    fprintf(stderr, "ERROR: fopen(): unable to open list '%s': %s\n", list, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  FILE* output_fp = stdout;
+
+  if (*output->value != 0 && (output_fp = fopen(output->value, "w")) == NULL) {
+    fprintf(stderr, "ERROR: fopen(): unable to open output file '%s': %s\n", output->value, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  pool_t*    pool = pool_create(strtoul(threads->value, 0, 10));
+  manifest_t manifest;
+
+  manifest_init(&manifest, pool, output_fp, *check->value != 0);
+  manifest_read(&manifest, list_fp, list);
+
+  if (list_fp != stdin)
+    fclose(list_fp);
+
+  uint64 failures = manifest_run(&manifest);
+
+  fprintf(stderr, "Hashed %llu files (%llu bytes) on %u threads\n", manifest.count - manifest.unreadable,
+          (uint64) manifest.bytes, pool->threads + 1);
+
+  if (manifest.unreadable != 0)
+    fprintf(stderr, "WARNING: %llu listed files could not be read\n", (uint64) manifest.unreadable);
+
+  if (manifest.mismatches != 0)
+    fprintf(stderr, "WARNING: %llu computed checksums did NOT match\n", (uint64) manifest.mismatches);
+
+  if (manifest.malformed != 0)
+    fprintf(stderr, "WARNING: %llu lines are improperly formatted\n", manifest.malformed);
+
+  if (output_fp != stdout)
+    fclose(output_fp);
+
+  manifest_destroy(&manifest);
+  pool_destroy(pool);
+
+  return failures != 0 || manifest.malformed != 0;
+}
+
+int handle_checksum(kvlist_t** head)
+{
+  kvlist_t* input   = kvlist_search(head, "if");
+  kvlist_t* leaf    = kvlist_search(head, "leaf");
+  kvlist_t* threads = kvlist_search(head, "threads");
+  kvlist_t* state   = kvlist_search(head, "state");
+  kvlist_t* sum     = kvlist_search(head, "sum");
+  kvlist_t* check   = kvlist_search(head, "check");
+
+  DEBUG_ASSERT(input != NULL);
+  DEBUG_ASSERT(leaf != NULL);
+  DEBUG_ASSERT(threads != NULL);
+  DEBUG_ASSERT(state != NULL);
+  DEBUG_ASSERT(sum != NULL);
+  DEBUG_ASSERT(check != NULL);
+
+  if (*sum->value != 0 || *check->value != 0)
+    return handle_manifest(head);
+
+  STATS_BEGIN(key_time);
+
+  zigma_t* poem = zigma_init(NULL, NULL, 0);
+
+  STATS_END(STATS_KEY, key_time, 0);
+
+  zigma_print(poem);
+
+  FILE* input_fp = stdin;
+
+  /* Setup the input. */
+  if (*input->value != 0) {
+    input_fp = fopen(input->value, "r");
+
+    if (input_fp == NULL) {
+      fprintf(stderr, "ERROR: fopen(): unable to open input file '%s': %s\n", input->value, strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+
+    fprintf(stderr, "Successfully opened input file '%s' for reading!\n", input->value);
+  }
+
+  uint64 leaf_size = str2bytes(leaf->value);
+
+  if (leaf_size != 0) {
+    if (*state->value != 0)
+      fprintf(stderr, "WARNING: handle_checksum(): state= does not apply to tree hashes, ignoring it\n");
+
+    handle_treehash(input, input_fp, leaf_size, strtoul(threads->value, 0, 10));
+    zigma_destroy(poem);
+    return 0;
+  }
+
+  uint64 resumed = 0;
+
+  if (*state->value != 0)
+    resumed = hash_resume(state->value, input_fp, poem);
+
+  /* Read the next blocks while the current one is hashed. */
+  stream_t stream = {.input_fp = input_fp, .limit = (uint64) -1, .ziggy = poem};
+  uint64   total  = resumed + pipeline_run(64 * 1024, stream_read, stream_hash, NULL, &stream);
+
+  if (stream_report(&stream, NULL))
+    exit(EXIT_FAILURE);
+
+  /* The state is saved before signing, which ends the hash. */
+  if (*state->value != 0)
+    hash_save(state->value, input_fp, poem, total);
+
+  uint8 checksum[32] = {0};
+
   zigma_hash_sign(poem, checksum, 32);
 
-  fprintf(stderr, "%s (%u bytes): ", input->value, total);
+  fprintf(stderr, "%s (%llu bytes): ", input->value, total);
   for (int j = 0; j < 24; j++)
     fprintf(stderr, "%02x", (unsigned char) checksum[j]);
 
   fprintf(stderr, "\n");
+
+  zigma_destroy(poem);
+
+  return 0;
+}
+
+void handle_random(kvlist_t** head)
+{
+  kvlist_t* output  = kvlist_search(head, "of");
+  kvlist_t* key     = kvlist_search(head, "key");
+  kvlist_t* seed    = kvlist_search(head, "seed");
+  kvlist_t* streams = kvlist_search(head, "streams");
+  kvlist_t* threads = kvlist_search(head, "threads");
+
+  DEBUG_ASSERT(output != NULL);
+  DEBUG_ASSERT(key != NULL);
+  DEBUG_ASSERT(seed != NULL);
+  DEBUG_ASSERT(streams != NULL);
+  DEBUG_ASSERT(threads != NULL);
+
+  uint64 stream_count = strtoull(streams->value, 0, 10);
+
+  if (stream_count > KEYSTREAM_MAX) {
+    fprintf(stderr, "ERROR: invalid stream count 'streams=%s', at most %u\n", streams->value, KEYSTREAM_MAX);
+    exit(EXIT_FAILURE);
+  }
+
+  if (stream_count == 0)
+    stream_count = 1;
+
+  FILE* output_fp = stdout;
+
+  /* Setup the output. */
+  if (*output->value != 0) {
+    output_fp = fopen(output->value, "w");
+
+    if (output_fp == NULL) {
+      fprintf(stderr, "ERROR: fopen(): unable to open output file '%s': %s!\n", output->value, strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+
+    fprintf(stderr, "Successfully opened output file '%s' for writing!\n", output->value);
+  }
+
+  uint8* passkey = secure_alloc(256);
+  uint32 keylen  = 0;
+
+  /* Seed from a key file, a string, or failing that the system. */
+  if (*key->value != 0) {
+    keylen = read_keyfile(key->value, passkey);
+  }
+  else if (*seed->value != 0) {
+    keylen = strlen(seed->value) < 256 ? strlen(seed->value) : 256;
+    memcpy(passkey, seed->value, keylen);
+  }
+  else {
+    FILE* urandom = fopen("/dev/urandom", "r");
+
+    if (urandom == NULL || (keylen = fread(passkey, 1, 256, urandom)) == 0) {
+      fprintf(stderr, "ERROR: unable to read /dev/urandom, use seed= or key=\n");
+      exit(EXIT_FAILURE);
+    }
+
+    fclose(urandom);
+
+    fprintf(stderr, "Seeded from /dev/urandom, the output is not reproducible\n");
+  }
+
+  zigma_t* base = zigma_init(NULL, passkey, keylen);
+
+  secure_free(passkey, 256);
+
+  span_t span;
+
+  parse_span(head, &span);
+  seek_output(output_fp, span.seek);
+
+  pool_t*      pool      = pool_create(strtoul(threads->value, 0, 10));
+  keystream_t* keystream = keystream_init(NULL, base, (uint32) stream_count);
+
+  zigma_destroy(base);
+
+  /* Produce several MB per write, whole rounds of every stream. */
+  uint64 rounds = 8 * 1024 * 1024 / (stream_count * KEYSTREAM_CHUNK);
+
+  if (rounds == 0)
+    rounds = 1;
+
+  uint64 size      = rounds * stream_count * KEYSTREAM_CHUNK;
+  uint8* buffer    = malloc(size);
+  uint64 remaining = span.count;
+  uint64 total     = 0;
+
+  DEBUG_ASSERT(buffer != NULL);
+
+  fprintf(stderr, "Generating %llu streams on %u threads\n", stream_count, pool->threads + 1);
+
+  while (remaining > 0) {
+    uint64 count = remaining < size ? remaining : size;
+
+    keystream_generate(keystream, pool, buffer, (uint32) rounds);
+
+    if (fwrite(buffer, 1, count, output_fp) != count) {
+      fprintf(stderr, "ERROR: fwrite(): unable to write output after %llu bytes: %s\n", total, strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+
+    remaining -= count;
+    total += count;
+  }
+
+  if (fflush(output_fp) != 0) {
+    fprintf(stderr, "ERROR: fflush(): unable to write output: %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  fprintf(stderr, "Complete! Total of %llu bytes written\n", total);
+
+  memnull(buffer, size);
+  free(buffer);
+
+  keystream_destroy(keystream);
+  pool_destroy(pool);
+}
+
+/* Expand the key once and serve requests with it until stopped. */
+void handle_serve(kvlist_t** head)
+{
+  kvlist_t* key  = kvlist_search(head, "key");
+  kvlist_t* sock = kvlist_search(head, "sock");
+
+  DEBUG_ASSERT(key != NULL);
+  DEBUG_ASSERT(sock != NULL);
+
+  if (*sock->value == 0) {
+    fprintf(stderr, "ERROR: the daemon needs a socket 'sock=PATH'\n");
+    exit(EXIT_FAILURE);
+  }
+
+  uint8* passkey = secure_alloc(256);
+  uint32 keylen  = 0;
+
+  if (*key->value != 0)
+    keylen = read_keyfile(key->value, passkey);
+  else
+    keylen = get_passwd(passkey, (uint8*) "enter passphrase: ");
+
+  zigma_t* ziggy = zigma_init(NULL, passkey, keylen);
+
+  secure_free(passkey, 256);
+  zigma_print(ziggy);
+
+  daemon_serve(sock->value, ziggy);
+
+  zigma_destroy(ziggy);
 }
 
 int main(int argc, char const* argv[])
@@ -551,6 +1865,12 @@ int main(int argc, char const* argv[])
 
   kvlist_print(&opt);
 
+  kvlist_t* stats = kvlist_search(&opt, "stats");
+
+  DEBUG_ASSERT(stats != NULL);
+
+  stats_start(stats->value);
+
   switch (command) {
     case MODE_NONE:
       print_usage(argv[0]);
@@ -559,21 +1879,36 @@ int main(int argc, char const* argv[])
 
     case MODE_ENCRYPT:
       handle_cipher(&opt);
+      stats_report();
       return 0;
       break;
 
     case MODE_DECRYPT:
       handle_decipher(&opt);
+      stats_report();
       return 0;
       break;
 
-    case MODE_HASH:
-      handle_checksum(&opt);
-      return 0;
+    case MODE_HASH: {
+      int status = handle_checksum(&opt);
+
+      stats_report();
+      return status;
       break;
+    }
 
     case MODE_RANDOM:
-      fprintf(stderr, "Not implemented yet!\n");
+      handle_random(&opt);
+      stats_report();
+      return 0;
+      break;
+
+    case MODE_SELFTEST:
+      return selftest_run() == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+      break;
+
+    case MODE_SERVE:
+      handle_serve(&opt);
       return 0;
       break;
   }
@@ -0,0 +1,135 @@
+/*
+ * ZIGMA, Copyright (C) 1999, 2005, 2023 Chase Zehl O'Byrne
+ *  <mail: zehl@live.com> http://zehlchen.com/
+ *
+ * This file is part of ZIGMA.
+ *
+ * ZIGMA is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ZIGMA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ZIGMA; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "hashstate.h"
+#include "zigma.h"
+
+/* Hash size bytes of a file from an offset, all of which must be there. */
+static int hashstate_probe(zigma_t* hash, int fd, uint64 offset, uint64 size)
+{
+  uint8 buffer[HASHSTATE_PROBE];
+
+  while (size > 0) {
+    ssize_t count = pread(fd, buffer, size < sizeof(buffer) ? size : sizeof(buffer), (off_t) offset);
+
+    if (count <= 0)
+      return 0;
+
+    zigma_hash_update(hash, buffer, count);
+    offset += count;
+    size -= count;
+  }
+
+  return 1;
+}
+
+int hashstate_fingerprint(int fd, uint64 offset, uint8* fingerprint)
+{
+  uint8   length[8];
+  uint64  head = offset < HASHSTATE_PROBE ? offset : HASHSTATE_PROBE;
+  uint64  tail = offset - head < HASHSTATE_PROBE ? offset - head : HASHSTATE_PROBE;
+  zigma_t hash;
+  int     status;
+
+  zigma_init_hash(&hash);
+
+  pack_uint64(length, offset);
+  zigma_hash_update(&hash, length, 8);
+
+  status = hashstate_probe(&hash, fd, 0, head) && hashstate_probe(&hash, fd, offset - tail, tail);
+
+  zigma_hash_sign(&hash, fingerprint, HASHSTATE_FINGERPRINT);
+
+  return status;
+}
+
+int hashstate_capture(hashstate_t* hs, zigma_t const* state, int fd, uint64 offset)
+{
+  DEBUG_ASSERT(hs != NULL);
+  DEBUG_ASSERT(state != NULL);
+
+  hs->offset = offset;
+  zigma_clone(&hs->state, state);
+
+  return hashstate_fingerprint(fd, offset, hs->fingerprint);
+}
+
+int hashstate_matches(hashstate_t const* hs, int fd)
+{
+  uint8       fingerprint[HASHSTATE_FINGERPRINT];
+  struct stat st;
+
+  DEBUG_ASSERT(hs != NULL);
+
+  /* The file must still hold the whole prefix. */
+  if (fstat(fd, &st) != 0 || (uint64) st.st_size < hs->offset)
+    return 0;
+
+  if (!hashstate_fingerprint(fd, hs->offset, fingerprint))
+    return 0;
+
+  return memcmp(fingerprint, hs->fingerprint, HASHSTATE_FINGERPRINT) == 0;
+}
+
+int hashstate_save(hashstate_t const* hs, FILE* fp)
+{
+  uint8 record[HASHSTATE_SIZE];
+
+  DEBUG_ASSERT(hs != NULL);
+  DEBUG_ASSERT(fp != NULL);
+
+  memcpy(record, HASHSTATE_MAGIC, 8);
+  pack_uint64(record + 8, hs->offset);
+  memcpy(record + 16, hs->fingerprint, HASHSTATE_FINGERPRINT);
+  zigma_export(&hs->state, record + 16 + HASHSTATE_FINGERPRINT);
+
+  if (fwrite(record, 1, HASHSTATE_SIZE, fp) != HASHSTATE_SIZE)
+    return 0;
+
+  return fflush(fp) == 0;
+}
+
+int hashstate_load(hashstate_t* hs, FILE* fp)
+{
+  uint8 record[HASHSTATE_SIZE];
+
+  DEBUG_ASSERT(hs != NULL);
+  DEBUG_ASSERT(fp != NULL);
+
+  if (fread(record, 1, HASHSTATE_SIZE, fp) != HASHSTATE_SIZE)
+    return 0;
+
+  if (memcmp(record, HASHSTATE_MAGIC, 8) != 0)
+    return 0;
+
+  hs->offset = unpack_uint64(record + 8);
+  memcpy(hs->fingerprint, record + 16, HASHSTATE_FINGERPRINT);
+
+  /* A damaged state does not give back a permutation. */
+  return zigma_import(&hs->state, record + 16 + HASHSTATE_FINGERPRINT) != NULL;
+}
@@ -0,0 +1,99 @@
+/*
+ * ZIGMA, Copyright (C) 1999, 2005, 2023 Chase Zehl O'Byrne
+ *  <mail: zehl@live.com> http://zehlchen.com/
+ *
+ * This file is part of ZIGMA.
+ *
+ * ZIGMA is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ZIGMA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ZIGMA; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#pragma once
+#ifndef _ZIGMA_HASHSTATE_H_
+#define _ZIGMA_HASHSTATE_H_
+
+#include <stdio.h>
+
+#include "zigma.h"
+
+/* A hash state file starts with this magic ... */
+#define HASHSTATE_MAGIC "ZIGMAHST"
+
+/* ... followed by the number of bytes hashed (64 bits, little-endian), the
+ * fingerprint of those bytes and the exported hash state.
+ */
+#define HASHSTATE_FINGERPRINT 24
+#define HASHSTATE_SIZE        (16 + HASHSTATE_FINGERPRINT + ZIGMA_STATE_SIZE)
+
+/* Bytes at each end of the hashed prefix that go into the fingerprint. */
+#define HASHSTATE_PROBE 4096
+
+/* The state of a hash after the first bytes of a file, so that hashing the
+ * file again after more data was appended to it only has to go over the new
+ * bytes. The fingerprint covers the length and both ends of the prefix; it
+ * catches a file that was truncated or rewritten, but it does not prove that
+ * the middle is unchanged.
+ */
+typedef struct hashstate_t {
+  /* Number of bytes of the file the state has seen. */
+  uint64 offset;
+
+  /* Digest of the length and of the first and last bytes of the prefix. */
+  uint8 fingerprint[HASHSTATE_FINGERPRINT];
+
+  /* The unsigned hash state after offset bytes. */
+  zigma_t state;
+} hashstate_t;
+
+/* Computes the fingerprint of the first bytes of a file, without moving its
+ * file offset.
+ *   @param fd The file, open for reading.
+ *   @param offset The length of the prefix.
+ *   @param fingerprint The HASHSTATE_FINGERPRINT byte output.
+ *   @return 1 on success, 0 if the prefix could not be read.
+ */
+int hashstate_fingerprint(int fd, uint64 offset, uint8* fingerprint);
+
+/* Records a hash state after the first bytes of a file.
+ *   @param hs The state to initialize.
+ *   @param state The hash, which has seen exactly offset bytes of the file.
+ *   @param fd The file, open for reading.
+ *   @param offset The number of bytes hashed.
+ *   @return 1 on success, 0 if the file could not be read.
+ */
+int hashstate_capture(hashstate_t* hs, zigma_t const* state, int fd, uint64 offset);
+
+/* Checks that a file still starts with the bytes a state has seen.
+ *   @param hs The loaded state.
+ *   @param fd The file, open for reading.
+ *   @return 1 if the fingerprints match, 0 otherwise.
+ */
+int hashstate_matches(hashstate_t const* hs, int fd);
+
+/* Writes a state file.
+ *   @param hs The state to write.
+ *   @param fp The state file, open for writing.
+ *   @return 1 on success, 0 if the file could not be written.
+ */
+int hashstate_save(hashstate_t const* hs, FILE* fp);
+
+/* Reads a state file.
+ *   @param hs The state to populate.
+ *   @param fp The state file, open for reading.
+ *   @return 1 on success, 0 if the file is not a hash state.
+ */
+int hashstate_load(hashstate_t* hs, FILE* fp);
+
+#endif /* _ZIGMA_HASHSTATE_H_ */
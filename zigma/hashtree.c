@@ -0,0 +1,119 @@
+/*
+ * ZIGMA, Copyright (C) 1999, 2005, 2023 Chase Zehl O'Byrne
+ *  <mail: zehl@live.com> http://zehlchen.com/
+ *
+ * This file is part of ZIGMA.
+ *
+ * ZIGMA is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ZIGMA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ZIGMA; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hashtree.h"
+#include "pool.h"
+#include "zigma.h"
+
+/* Work order shared by the leaf jobs. */
+typedef struct hashtree_job_t {
+  uint8 const* data;
+  uint64       size;
+  uint64       leaf_size;
+  uint8*       digests;
+} hashtree_job_t;
+
+hashtree_t* hashtree_init(hashtree_t* tree, uint64 leaf_size)
+{
+  uint8 encoded[8];
+
+  DEBUG_ASSERT(tree != NULL);
+  DEBUG_ASSERT(leaf_size != 0);
+
+  tree->leaf_size = leaf_size;
+  tree->leaves    = 0;
+  tree->length    = 0;
+
+  zigma_init_hash(&tree->root);
+
+  pack_uint64(encoded, leaf_size);
+  zigma_hash_update(&tree->root, encoded, 8);
+
+  return tree;
+}
+
+void hashtree_leaf(uint8* digest, uint8 const* data, uint64 size)
+{
+  zigma_t leaf;
+
+  zigma_init_hash(&leaf);
+
+  zigma_hash_update(&leaf, data, size);
+  zigma_hash_sign(&leaf, digest, ZIGMA_CHECKSUM_SIZE);
+}
+
+static void hashtree_run(void* arg, uint32 index)
+{
+  hashtree_job_t* job    = arg;
+  uint64          offset = (uint64) index * job->leaf_size;
+  uint64          size   = job->size - offset;
+
+  if (size > job->leaf_size)
+    size = job->leaf_size;
+
+  hashtree_leaf(job->digests + (uint64) index * ZIGMA_CHECKSUM_SIZE, job->data + offset, size);
+}
+
+void hashtree_update(hashtree_t* tree, pool_t* pool, uint8 const* data, uint64 size)
+{
+  if (size == 0)
+    return;
+
+  hashtree_job_t job;
+  uint32         count = (uint32) ((size + tree->leaf_size - 1) / tree->leaf_size);
+
+  job.data      = data;
+  job.size      = size;
+  job.leaf_size = tree->leaf_size;
+  job.digests   = (uint8*) malloc((uint64) count * ZIGMA_CHECKSUM_SIZE);
+
+  DEBUG_ASSERT(job.digests != NULL);
+
+  pool_for(pool, count, hashtree_run, &job);
+
+  /* The root takes the digests in leaf order, whatever order they finished. */
+  hashtree_absorb(tree, job.digests, count, size);
+
+  free(job.digests);
+}
+
+void hashtree_absorb(hashtree_t* tree, uint8 const* digests, uint32 count, uint64 size)
+{
+  zigma_hash_update(&tree->root, digests, (uint64) count * ZIGMA_CHECKSUM_SIZE);
+
+  tree->leaves += count;
+  tree->length += size;
+}
+
+void hashtree_final(hashtree_t* tree, uint8* digest, uint32 length)
+{
+  uint8 encoded[8];
+
+  pack_uint64(encoded, tree->length);
+  zigma_hash_update(&tree->root, encoded, 8);
+
+  zigma_hash_sign(&tree->root, digest, length);
+}
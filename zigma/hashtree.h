@@ -0,0 +1,89 @@
+/*
+ * ZIGMA, Copyright (C) 1999, 2005, 2023 Chase Zehl O'Byrne
+ *  <mail: zehl@live.com> http://zehlchen.com/
+ *
+ * This file is part of ZIGMA.
+ *
+ * ZIGMA is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ZIGMA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ZIGMA; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#pragma once
+#ifndef _ZIGMA_HASHTREE_H_
+#define _ZIGMA_HASHTREE_H_
+
+#include "pool.h"
+#include "zigma.h"
+
+/* A two-level hash tree.
+ * The input is cut into leaves of leaf_size bytes, each leaf is hashed on its
+ * own (so leaves can be hashed in parallel), and the root hash absorbs the
+ * leaf size, every leaf digest in order and finally the total length.
+ */
+typedef struct hashtree_t {
+  /* Size of each leaf in bytes. */
+  uint64 leaf_size;
+
+  /* Number of leaves absorbed so far. */
+  uint64 leaves;
+
+  /* Number of bytes hashed so far. */
+  uint64 length;
+
+  /* The root hash state. */
+  zigma_t root;
+} hashtree_t;
+
+/* Initializes a hash tree.
+ *   @param tree The tree to initialize.
+ *   @param leaf_size The size of each leaf in bytes (non-zero).
+ *   @return The initialized tree.
+ */
+hashtree_t* hashtree_init(hashtree_t* tree, uint64 leaf_size);
+
+/* Hashes a single leaf.
+ *   @param digest The ZIGMA_CHECKSUM_SIZE byte leaf digest to populate.
+ *   @param data The leaf data.
+ *   @param size The size of the leaf in bytes.
+ */
+void hashtree_leaf(uint8* digest, uint8 const* data, uint64 size);
+
+/* Hashes consecutive leaves, in parallel, and absorbs them into the root.
+ * Only the last call may end with a partial leaf.
+ *   @param tree The tree to update.
+ *   @param pool The pool to run on, or NULL to run serially.
+ *   @param data The data, a whole number of leaves except at the very end.
+ *   @param size The size of the data in bytes.
+ */
+void hashtree_update(hashtree_t* tree, pool_t* pool, uint8 const* data, uint64 size);
+
+/* Absorbs the digests of consecutive leaves hashed elsewhere, the way
+ * hashtree_leaf() does but piece by piece, for leaves too large to hold in
+ * memory.
+ *   @param tree The tree to update.
+ *   @param digests The ZIGMA_CHECKSUM_SIZE byte digests, in leaf order.
+ *   @param count The number of leaves.
+ *   @param size The total size of the leaves in bytes.
+ */
+void hashtree_absorb(hashtree_t* tree, uint8 const* digests, uint32 count, uint64 size);
+
+/* Produces the root digest.
+ *   @param tree The tree to finish.
+ *   @param digest The checksum value to be populated.
+ *   @param length The length of the checksum in bytes.
+ */
+void hashtree_final(hashtree_t* tree, uint8* digest, uint32 length);
+
+#endif /* _ZIGMA_HASHTREE_H_ */
@@ -0,0 +1,150 @@
+/*
+ * ZIGMA, Copyright (C) 1999, 2005, 2023 Chase Zehl O'Byrne
+ *  <mail: zehl@live.com> http://zehlchen.com/
+ *
+ * This file is part of ZIGMA.
+ *
+ * ZIGMA is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ZIGMA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ZIGMA; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "keycache.h"
+#include "secure.h"
+#include "zigma.h"
+
+/* Hash a key eight bytes at a time; good enough to spread slots and to reject
+ * nearly every mismatch before comparing keys.
+ */
+static uint64 keycache_fingerprint(uint8 const* key, uint32 length)
+{
+  uint64 hash = 0x9E3779B97F4A7C15ULL ^ length;
+  uint32 i    = 0;
+
+  for (; i + 8 <= length; i += 8) {
+    uint64 word;
+
+    memcpy(&word, key + i, 8);
+    hash = (hash ^ word) * 0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 32;
+  }
+
+  for (; i < length; i++)
+    hash = (hash ^ key[i]) * 0x100000001B3ULL;
+
+  hash ^= hash >> 29;
+  hash *= 0xC4CEB9FE1A85EC53ULL;
+  hash ^= hash >> 32;
+
+  return hash;
+}
+
+/* Compares two keys in time that depends only on their length, so that a
+ * lookup does not reveal how much of a cached key a caller guessed right.
+ */
+static int keycache_equal(uint8 const* a, uint8 const* b, uint32 length)
+{
+  uint8 diff = 0;
+
+  for (uint32 i = 0; i < length; i++)
+    diff |= a[i] ^ b[i];
+
+  return diff == 0;
+}
+
+keycache_t* keycache_init(keycache_t* cache, uint32 slots)
+{
+  if (cache == NULL)
+    cache = (keycache_t*) malloc(sizeof(keycache_t));
+
+  DEBUG_ASSERT(cache != NULL);
+
+  cache->slots = KEYCACHE_WAYS;
+
+  while (cache->slots < slots)
+    cache->slots <<= 1;
+
+  DEBUG_ASSERT((uint64) cache->slots * sizeof(keycache_entry_t) <= 0xFFFFFFFF);
+
+  /* Keys and expanded states are secrets: locked, guarded, never dumped. */
+  cache->tick    = 0;
+  cache->hits    = 0;
+  cache->misses  = 0;
+  cache->entries = (keycache_entry_t*) secure_alloc(cache->slots * sizeof(keycache_entry_t));
+
+  return cache;
+}
+
+zigma_t* keycache_fetch(keycache_t* cache, zigma_t* handle, uint8 const* key, uint32 length)
+{
+  DEBUG_ASSERT(cache != NULL);
+  DEBUG_ASSERT(key != NULL);
+  DEBUG_ASSERT(length > 0 && length <= 256);
+
+  uint64            fingerprint = keycache_fingerprint(key, length);
+  uint32            first       = (uint32) fingerprint & (cache->slots - 1) & ~(KEYCACHE_WAYS - 1);
+  keycache_entry_t* victim      = &cache->entries[first];
+
+  for (uint32 way = 0; way < KEYCACHE_WAYS; way++) {
+    keycache_entry_t* entry = &cache->entries[first + way];
+
+    if (entry->keylen == length && entry->fingerprint == fingerprint && keycache_equal(entry->key, key, length)) {
+      entry->used = ++cache->tick;
+      cache->hits++;
+
+      return zigma_clone(handle, &entry->state);
+    }
+
+    /* Prefer an empty slot, otherwise the least recently used. */
+    if (victim->keylen != 0 && (entry->keylen == 0 || entry->used < victim->used))
+      victim = entry;
+  }
+
+  cache->misses++;
+
+  memnull(victim, sizeof(keycache_entry_t));
+
+  zigma_init(&victim->state, key, length);
+  memcpy(victim->key, key, length);
+
+  victim->fingerprint = fingerprint;
+  victim->keylen      = length;
+  victim->used        = ++cache->tick;
+
+  return zigma_clone(handle, &victim->state);
+}
+
+void keycache_clear(keycache_t* cache)
+{
+  DEBUG_ASSERT(cache != NULL);
+
+  memnull(cache->entries, cache->slots * sizeof(keycache_entry_t));
+}
+
+keycache_t* keycache_destroy(keycache_t* cache)
+{
+  DEBUG_ASSERT(cache != NULL);
+
+  keycache_clear(cache);
+  secure_free(cache->entries, cache->slots * sizeof(keycache_entry_t));
+
+  memnull(cache, sizeof(keycache_t));
+  free(cache);
+
+  return NULL;
+}
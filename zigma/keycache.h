@@ -0,0 +1,95 @@
+/*
+ * ZIGMA, Copyright (C) 1999, 2005, 2023 Chase Zehl O'Byrne
+ *  <mail: zehl@live.com> http://zehlchen.com/
+ *
+ * This file is part of ZIGMA.
+ *
+ * ZIGMA is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ZIGMA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ZIGMA; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#pragma once
+#ifndef _ZIGMA_KEYCACHE_H_
+#define _ZIGMA_KEYCACHE_H_
+
+#include "zigma.h"
+
+/* Number of slots probed for a key; the cache is this-way set associative. */
+#define KEYCACHE_WAYS 4
+
+/* One expanded key. */
+typedef struct keycache_entry_t {
+  /* Fingerprint of the key, checked before the key itself. */
+  uint64 fingerprint;
+
+  /* Last use, for least-recently-used eviction. */
+  uint64 used;
+
+  /* Length of the key in bytes, 0 when the slot is empty. */
+  uint32 keylen;
+
+  /* The key, compared in full (in constant time) on a fingerprint match. */
+  uint8 key[256];
+
+  /* The state zigma_init() produced for the key. */
+  zigma_t state;
+} keycache_entry_t;
+
+/* A fixed-size cache of expanded keys. Fetching a cached key copies its
+ * state instead of running the key schedule. Not thread-safe.
+ */
+typedef struct keycache_t {
+  /* Number of slots, a power of two. */
+  uint32 slots;
+
+  /* Use counter driving the eviction policy. */
+  uint64 tick;
+
+  /* Statistics. */
+  uint64 hits;
+  uint64 misses;
+
+  /* The slots, in locked memory from secure_alloc(). */
+  keycache_entry_t* entries;
+} keycache_t;
+
+/* Initializes and allocates a key cache.
+ *   @param cache The cache to initialize, or NULL to allocate one.
+ *   @param slots The number of slots, rounded up to a power of two.
+ *   @return The initialized cache, whose slots live in secure memory.
+ */
+keycache_t* keycache_init(keycache_t* cache, uint32 slots);
+
+/* Produces the expanded state for a key, from the cache when possible.
+ *   @param cache The cache to look in.
+ *   @param handle The zigma object to populate, or NULL to allocate one.
+ *   @param key The key.
+ *   @param length The length of the key in bytes (1 to 256).
+ *   @return The populated zigma object, ready to encrypt or decrypt.
+ */
+zigma_t* keycache_fetch(keycache_t* cache, zigma_t* handle, uint8 const* key, uint32 length);
+
+/* Securely wipes every cached key and state.
+ *   @param cache The cache to clear.
+ */
+void keycache_clear(keycache_t* cache);
+
+/* Securely destroys a key cache.
+ *   @param cache The cache to destroy.
+ *   @return NULL.
+ */
+keycache_t* keycache_destroy(keycache_t* cache);
+
+#endif /* _ZIGMA_KEYCACHE_H_ */
@@ -0,0 +1,91 @@
+/*
+ * ZIGMA, Copyright (C) 1999, 2005, 2023 Chase Zehl O'Byrne
+ *  <mail: zehl@live.com> http://zehlchen.com/
+ *
+ * This file is part of ZIGMA.
+ *
+ * ZIGMA is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ZIGMA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ZIGMA; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "keystream.h"
+#include "pool.h"
+#include "secure.h"
+#include "segment.h"
+#include "zigma.h"
+
+/* Work order shared by the stream jobs. */
+typedef struct keystream_job_t {
+  keystream_t* keystream;
+  uint8*       data;
+  uint32       rounds;
+} keystream_job_t;
+
+keystream_t* keystream_init(keystream_t* keystream, zigma_t const* base, uint32 streams)
+{
+  DEBUG_ASSERT(base != NULL);
+  DEBUG_ASSERT(streams != 0 && streams <= KEYSTREAM_MAX);
+
+  if (keystream == NULL)
+    keystream = (keystream_t*) malloc(sizeof(keystream_t));
+
+  DEBUG_ASSERT(keystream != NULL);
+
+  keystream->streams = streams;
+  keystream->states  = (zigma_t*) secure_alloc(streams * sizeof(zigma_t));
+
+  DEBUG_ASSERT(keystream->states != NULL);
+
+  for (uint32 s = 0; s < streams; s++)
+    segment_derive(&keystream->states[s], base, KEYSTREAM_DOMAIN | s);
+
+  return keystream;
+}
+
+static void keystream_run(void* arg, uint32 stream)
+{
+  keystream_job_t* job     = arg;
+  uint32           streams = job->keystream->streams;
+
+  for (uint32 r = 0; r < job->rounds; r++) {
+    uint8* chunk = job->data + ((uint64) r * streams + stream) * KEYSTREAM_CHUNK;
+
+    memset(chunk, 0, KEYSTREAM_CHUNK);
+    zigma_encrypt(&job->keystream->states[stream], chunk, KEYSTREAM_CHUNK);
+  }
+}
+
+void keystream_generate(keystream_t* keystream, pool_t* pool, uint8* data, uint32 rounds)
+{
+  keystream_job_t job = {keystream, data, rounds};
+
+  pool_for(pool, keystream->streams, keystream_run, &job);
+}
+
+keystream_t* keystream_destroy(keystream_t* keystream)
+{
+  DEBUG_ASSERT(keystream != NULL);
+
+  secure_free(keystream->states, keystream->streams * sizeof(zigma_t));
+
+  memnull(keystream, sizeof(keystream_t));
+  free(keystream);
+
+  return NULL;
+}
@@ -0,0 +1,78 @@
+/*
+ * ZIGMA, Copyright (C) 1999, 2005, 2023 Chase Zehl O'Byrne
+ *  <mail: zehl@live.com> http://zehlchen.com/
+ *
+ * This file is part of ZIGMA.
+ *
+ * ZIGMA is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ZIGMA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ZIGMA; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#pragma once
+#ifndef _ZIGMA_KEYSTREAM_H_
+#define _ZIGMA_KEYSTREAM_H_
+
+#include "pool.h"
+#include "zigma.h"
+
+/* Size of the chunk each stream contributes in turn. */
+#define KEYSTREAM_CHUNK (64 * 1024)
+
+/* Streams are derived like segments, from a range of indexes disjoint from
+ * segments and from checkpoint seals, so that no stream reproduces the
+ * ciphertext of a segment enciphered with the same key.
+ */
+#define KEYSTREAM_DOMAIN (1ULL << 62)
+
+/* Largest number of streams; a round of them is KEYSTREAM_MAX chunks. */
+#define KEYSTREAM_MAX 4096
+
+/* A deterministic pseudorandom byte generator built from several streams.
+ * Stream S runs the state segment_derive(base, KEYSTREAM_DOMAIN | S) over
+ * zero bytes. The output is the streams' chunks interleaved round-robin:
+ * chunk C comes from stream C % streams. The layout depends only on the key
+ * and the number of streams, never on the number of threads.
+ */
+typedef struct keystream_t {
+  /* Number of independent streams. */
+  uint32 streams;
+
+  /* The state of each stream. */
+  zigma_t* states;
+} keystream_t;
+
+/* Initializes a keystream.
+ *   @param keystream The keystream to initialize, or NULL to allocate one.
+ *   @param base The zigma object initialized with the key or seed.
+ *   @param streams The number of streams (1 to KEYSTREAM_MAX).
+ *   @return The initialized keystream.
+ */
+keystream_t* keystream_init(keystream_t* keystream, zigma_t const* base, uint32 streams);
+
+/* Produces the next rounds of output, every stream in parallel.
+ *   @param keystream The keystream to advance.
+ *   @param pool The pool to run on, or NULL to run serially.
+ *   @param data The output buffer, rounds * streams * KEYSTREAM_CHUNK bytes.
+ *   @param rounds The number of rounds to produce.
+ */
+void keystream_generate(keystream_t* keystream, pool_t* pool, uint8* data, uint32 rounds);
+
+/* Securely destroys a keystream.
+ *   @param keystream The keystream to destroy.
+ *   @return NULL.
+ */
+keystream_t* keystream_destroy(keystream_t* keystream);
+
+#endif /* _ZIGMA_KEYSTREAM_H_ */
@@ -0,0 +1,281 @@
+/*
+ * ZIGMA, Copyright (C) 1999, 2005, 2023 Chase Zehl O'Byrne
+ *  <mail: zehl@live.com> http://zehlchen.com/
+ *
+ * This file is part of ZIGMA.
+ *
+ * ZIGMA is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ZIGMA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ZIGMA; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "manifest.h"
+#include "pool.h"
+#include "stats.h"
+#include "zigma.h"
+
+void manifest_init(manifest_t* manifest, pool_t* pool, FILE* output_fp, int check)
+{
+  DEBUG_ASSERT(manifest != NULL);
+  DEBUG_ASSERT(output_fp != NULL);
+
+  memset(manifest, 0, sizeof(manifest_t));
+
+  manifest->pool      = pool;
+  manifest->output_fp = output_fp;
+  manifest->check     = check;
+
+  pthread_mutex_init(&manifest->lock, NULL);
+}
+
+static manifest_entry_t* manifest_add(manifest_t* manifest, char const* path)
+{
+  if (manifest->count == manifest->capacity) {
+    manifest->capacity = manifest->capacity ? manifest->capacity * 2 : 1024;
+    manifest->entries  = (manifest_entry_t**) realloc(manifest->entries, manifest->capacity * sizeof(manifest_entry_t*));
+
+    DEBUG_ASSERT(manifest->entries != NULL);
+  }
+
+  manifest_entry_t* entry = (manifest_entry_t*) calloc(1, sizeof(manifest_entry_t));
+
+  DEBUG_ASSERT(entry != NULL);
+
+  entry->path = safe_strdup(path);
+
+  manifest->entries[manifest->count++] = entry;
+
+  return entry;
+}
+
+static int manifest_hex(char digit)
+{
+  return isdigit((unsigned char) digit) ? digit - '0' : tolower((unsigned char) digit) - 'a' + 10;
+}
+
+/* Split a "DIGEST  PATH" line; the digest is hexadecimal and the path may be
+ * marked binary with a '*' in place of the second space.
+ */
+static int manifest_parse(char* line, uint8* digest, char** path)
+{
+  for (int i = 0; i < MANIFEST_DIGEST * 2; i++) {
+    if (!isxdigit((unsigned char) line[i]))
+      return 0;
+  }
+
+  if (line[MANIFEST_DIGEST * 2] != ' ' || (line[MANIFEST_DIGEST * 2 + 1] != ' ' && line[MANIFEST_DIGEST * 2 + 1] != '*'))
+    return 0;
+
+  for (int i = 0; i < MANIFEST_DIGEST; i++)
+    digest[i] = manifest_hex(line[2 * i]) << 4 | manifest_hex(line[2 * i + 1]);
+
+  *path = line + MANIFEST_DIGEST * 2 + 2;
+
+  return **path != '\0';
+}
+
+void manifest_read(manifest_t* manifest, FILE* fp, char const* name)
+{
+  char*   line   = NULL;
+  size_t  size   = 0;
+  uint64  number = 0;
+  ssize_t length;
+
+  while ((length = getline(&line, &size, fp)) >= 0) {
+    number++;
+
+    while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r'))
+      line[--length] = '\0';
+
+    if (length == 0 || line[0] == '#')
+      continue;
+
+    if (!manifest->check) {
+      manifest_add(manifest, line);
+      continue;
+    }
+
+    uint8 digest[MANIFEST_DIGEST];
+    char* path;
+
+    if (!manifest_parse(line, digest, &path)) {
+      fprintf(stderr, "WARNING: %s:%llu: improperly formatted checksum line\n", name, number);
+      manifest->malformed++;
+      continue;
+    }
+
+    memcpy(manifest_add(manifest, path)->expect, digest, MANIFEST_DIGEST);
+  }
+
+  free(line);
+}
+
+/* Hash one file from start to end.
+ *   @return 1 on success, 0 (with errno set) if it could not be read.
+ */
+static int manifest_hash(manifest_t* manifest, char const* path, uint8* digest)
+{
+  int fd = open(path, O_RDONLY);
+
+  if (fd < 0)
+    return 0;
+
+#ifdef POSIX_FADV_SEQUENTIAL
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+  uint8*  block = (uint8*) malloc(MANIFEST_BLOCK);
+  uint64  total = 0;
+  ssize_t count;
+  zigma_t hash;
+
+  DEBUG_ASSERT(block != NULL);
+
+  zigma_init_hash(&hash);
+
+  while (1) {
+    STATS_BEGIN(read_time);
+
+    count = read(fd, block, MANIFEST_BLOCK);
+
+    if (count < 0 && errno == EINTR)
+      continue;
+
+    if (count <= 0)
+      break;
+
+    STATS_END(STATS_READ, read_time, count);
+    STATS_BEGIN(hash_time);
+
+    zigma_hash_update(&hash, block, count);
+    total += count;
+
+    STATS_END(STATS_HASH, hash_time, count);
+  }
+
+  int error = errno;
+
+  free(block);
+  close(fd);
+
+  if (count < 0) {
+    errno = error;
+    return 0;
+  }
+
+  zigma_hash_sign(&hash, digest, MANIFEST_DIGEST);
+  atomic_fetch_add(&manifest->bytes, total);
+
+  return 1;
+}
+
+static void manifest_write_sum(manifest_t* manifest, manifest_entry_t const* entry)
+{
+  for (int i = 0; i < MANIFEST_DIGEST; i++)
+    fprintf(manifest->output_fp, "%02x", entry->digest[i]);
+
+  fprintf(manifest->output_fp, "  %s\n", entry->path);
+}
+
+static void manifest_write_check(manifest_t* manifest, manifest_entry_t const* entry)
+{
+  switch (entry->status) {
+    case MANIFEST_OK:
+      fprintf(manifest->output_fp, "%s: OK\n", entry->path);
+      break;
+
+    case MANIFEST_FAILED:
+      fprintf(manifest->output_fp, "%s: FAILED\n", entry->path);
+      fflush(manifest->output_fp);
+      break;
+
+    default:
+      fprintf(manifest->output_fp, "%s: FAILED open or read\n", entry->path);
+      fflush(manifest->output_fp);
+      break;
+  }
+}
+
+static void manifest_task(void* arg, uint32 index)
+{
+  manifest_t*       manifest = arg;
+  manifest_entry_t* entry    = manifest->entries[index];
+  manifest_status_t status   = MANIFEST_OK;
+
+  if (!manifest_hash(manifest, entry->path, entry->digest)) {
+    fprintf(stderr, "ERROR: unable to hash '%s': %s\n", entry->path, strerror(errno));
+    atomic_fetch_add(&manifest->unreadable, 1);
+    status = MANIFEST_UNREADABLE;
+  }
+  else if (manifest->check && memcmp(entry->digest, entry->expect, MANIFEST_DIGEST) != 0) {
+    atomic_fetch_add(&manifest->mismatches, 1);
+    status = MANIFEST_FAILED;
+  }
+
+  pthread_mutex_lock(&manifest->lock);
+
+  entry->status = status;
+
+  if (manifest->check)
+    manifest_write_check(manifest, entry);
+
+  /* Sums go out in the order of the list, as far as it is complete. */
+  while (!manifest->check && manifest->cursor < manifest->count) {
+    manifest_entry_t const* next = manifest->entries[manifest->cursor];
+
+    if (next->status == MANIFEST_PENDING)
+      break;
+
+    if (next->status == MANIFEST_OK)
+      manifest_write_sum(manifest, next);
+
+    manifest->cursor++;
+  }
+
+  pthread_mutex_unlock(&manifest->lock);
+}
+
+uint64 manifest_run(manifest_t* manifest)
+{
+  DEBUG_ASSERT(manifest != NULL);
+
+  DEBUG_ASSERT(manifest->count <= 0xFFFFFFFFULL);
+
+  /* Files are handed out in the order of the list, so sums go out steadily. */
+  pool_for(manifest->pool, (uint32) manifest->count, manifest_task, manifest);
+  fflush(manifest->output_fp);
+
+  return atomic_load(&manifest->mismatches) + atomic_load(&manifest->unreadable);
+}
+
+void manifest_destroy(manifest_t* manifest)
+{
+  DEBUG_ASSERT(manifest != NULL);
+
+  for (uint64 i = 0; i < manifest->count; i++) {
+    free(manifest->entries[i]->path);
+    free(manifest->entries[i]);
+  }
+
+  free(manifest->entries);
+  pthread_mutex_destroy(&manifest->lock);
+}
@@ -0,0 +1,117 @@
+/*
+ * ZIGMA, Copyright (C) 1999, 2005, 2023 Chase Zehl O'Byrne
+ *  <mail: zehl@live.com> http://zehlchen.com/
+ *
+ * This file is part of ZIGMA.
+ *
+ * ZIGMA is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ZIGMA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ZIGMA; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#pragma once
+#ifndef _ZIGMA_MANIFEST_H_
+#define _ZIGMA_MANIFEST_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+
+#include "pool.h"
+#include "zigma.h"
+
+/* Bytes of the checksum recorded for every file. */
+#define MANIFEST_DIGEST 32
+
+/* Bytes read from a file at a time. */
+#define MANIFEST_BLOCK (256 * 1024)
+
+typedef enum manifest_status_t {
+  MANIFEST_PENDING = 0,
+  MANIFEST_OK,
+  MANIFEST_FAILED,
+  MANIFEST_UNREADABLE
+} manifest_status_t;
+
+/* One file of a manifest. */
+typedef struct manifest_entry_t {
+  /* The path of the file, as listed. */
+  char* path;
+
+  /* The checksum listed for the file (when checking) and the one computed. */
+  uint8 expect[MANIFEST_DIGEST];
+  uint8 digest[MANIFEST_DIGEST];
+
+  /* The outcome, set once the file has been hashed. */
+  manifest_status_t status;
+} manifest_entry_t;
+
+/* A list of files to hash or to check, one file at a time per thread. Sums are
+ * written as "DIGEST  PATH" lines in the order the files were listed, like
+ * sha256sum(1) does; results of a check are written as soon as every file is
+ * done, so that mismatches show up while the rest is still being read.
+ */
+typedef struct manifest_t {
+  /* The pool the files are hashed on and where the results go. */
+  pool_t* pool;
+  FILE*   output_fp;
+
+  /* Whether the listed checksums are verified rather than computed. */
+  int check;
+
+  /* The files, and the first one whose sum has not been written yet. */
+  manifest_entry_t** entries;
+  uint64             count;
+  uint64             capacity;
+  uint64             cursor;
+
+  /* Serializes the output. */
+  pthread_mutex_t lock;
+
+  /* Bytes hashed, mismatches, unreadable files and malformed lines so far. */
+  atomic_ullong bytes;
+  atomic_ullong mismatches;
+  atomic_ullong unreadable;
+  uint64        malformed;
+} manifest_t;
+
+/* Initializes an empty manifest.
+ *   @param manifest The manifest to initialize.
+ *   @param pool The pool to hash on, or NULL to hash on the calling thread.
+ *   @param output_fp Where the sums or the results go.
+ *   @param check 0 to compute sums, 1 to verify them.
+ */
+void manifest_init(manifest_t* manifest, pool_t* pool, FILE* output_fp, int check);
+
+/* Reads the files to process: one path per line to compute sums, or
+ * "DIGEST  PATH" lines (as written by the sums) to verify them. Empty lines
+ * and lines starting with '#' are skipped, malformed ones are counted.
+ *   @param manifest The manifest to add the files to.
+ *   @param fp The list, open for reading.
+ *   @param name The name of the list, for messages.
+ */
+void manifest_read(manifest_t* manifest, FILE* fp, char const* name);
+
+/* Hashes every file of the manifest and writes the results.
+ *   @param manifest The manifest to process.
+ *   @return The number of files that were unreadable or did not match.
+ */
+uint64 manifest_run(manifest_t* manifest);
+
+/* Frees the files of a manifest.
+ *   @param manifest The manifest to destroy.
+ */
+void manifest_destroy(manifest_t* manifest);
+
+#endif /* _ZIGMA_MANIFEST_H_ */
@@ -23,11 +23,47 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 
 #include "matrix.h"
+#include "secure.h"
 #include "zigma.h"
 
-matrix_t* matrix_init(matrix_t* matrix, uint32 size_request)
+/* Allocate a data block, aligned for and backed by transparent hugepages
+ * when it is large enough for them to matter.
+ */
+static uint8* matrix_alloc(uint64 capacity)
+{
+  void*  data  = NULL;
+  uint64 align = capacity < MATRIX_HUGEPAGE ? 4096 : MATRIX_HUGEPAGE;
+
+  if (posix_memalign(&data, align, capacity) != 0)
+    data = NULL;
+
+  DEBUG_ASSERT(data != NULL);
+
+#ifdef MADV_HUGEPAGE
+  if (capacity >= MATRIX_HUGEPAGE)
+    madvise(data, capacity, MADV_HUGEPAGE);
+#endif
+
+  /* Plaintext has no business in a core dump. */
+  secure_advise(data, capacity);
+
+  return (uint8*) data;
+}
+
+/* The capacity to allocate for a request: a whole square, so that the
+ * matrix can always be transposed in place, and at least 1 MB.
+ */
+static uint64 matrix_capacity(uint64 size_request)
+{
+  uint64 magnitude = matrix_smallest_magnitude(size_request > 1024 * 1024 ? size_request : 1024 * 1024);
+
+  return magnitude * magnitude;
+}
+
+matrix_t* matrix_init(matrix_t* matrix, uint64 size_request)
 {
   if (matrix == NULL)
     matrix = (matrix_t*) malloc(sizeof(matrix_t));
@@ -43,16 +79,13 @@ matrix_t* matrix_init(matrix_t* matrix, uint32 size_request)
     return matrix;
   }
 
-  uint32 magnitude = matrix_smallest_magnitude(size_request);
-  uint32 capacity  = (magnitude * magnitude) > 1024 * 1024 ? magnitude * magnitude : 1024 * 1024; // 1MB minimum
+  uint64 capacity = matrix_capacity(size_request);
 
-  matrix->data = (uint8*) malloc(capacity * sizeof(uint8));
-
-  DEBUG_ASSERT(matrix->data != NULL);
+  matrix->data = matrix_alloc(capacity);
 
   matrix->length    = size_request;
   matrix->capacity  = capacity;
-  matrix->magnitude = magnitude;
+  matrix->magnitude = matrix_smallest_magnitude(size_request);
 
   return matrix;
 }
@@ -62,50 +95,204 @@ matrix_t* matrix_destroy(matrix_t* matrix)
   DEBUG_ASSERT(matrix != NULL);
 
   memnull(matrix->data, matrix->capacity * sizeof(uint8));
-  memnull(matrix, sizeof(matrix_t));
-
   free(matrix->data);
+
+  memnull(matrix, sizeof(matrix_t));
   free(matrix);
 
   return NULL;
 }
 
-matrix_t* matrix_resize(matrix_t* matrix, uint32 size_request)
+matrix_t* matrix_reserve(matrix_t* matrix, uint64 size_request)
 {
   DEBUG_ASSERT(matrix != NULL);
 
-  uint32 magnitude = matrix_smallest_magnitude(size_request);
+  if (size_request <= matrix->capacity)
+    return matrix;
 
-  if (size_request <= matrix->capacity) {
-    matrix->length    = size_request;
-    matrix->magnitude = magnitude;
+  /* Grow geometrically so that growing byte by byte is still linear. */
+  uint64 doubled  = matrix->capacity * 2;
+  uint64 capacity = matrix_capacity(doubled > size_request ? doubled : size_request);
+  uint8* data     = matrix_alloc(capacity);
 
-    return matrix;
+  if (matrix->data != NULL) {
+    memcpy(data, matrix->data, matrix->length);
+    memnull(matrix->data, matrix->length);
+    free(matrix->data);
   }
 
-  uint32 capacity = (magnitude * magnitude) > 1024 * 1024 ? magnitude * magnitude : 1024 * 1024; // 1MB minimum
+  matrix->data     = data;
+  matrix->capacity = capacity;
 
-  matrix->data = (uint8*) realloc(matrix->data, capacity * sizeof(uint8));
+  return matrix;
+}
 
-  DEBUG_ASSERT(matrix->data != NULL);
+matrix_t* matrix_resize(matrix_t* matrix, uint64 size_request)
+{
+  matrix_reserve(matrix, size_request);
 
-  matrix->capacity  = capacity;
-  matrix->magnitude = magnitude;
+  matrix->length    = size_request;
+  matrix->magnitude = matrix_smallest_magnitude(size_request);
 
   return matrix;
 }
 
-uint32 matrix_smallest_magnitude(uint32 request_size)
+uint64 matrix_smallest_magnitude(uint64 request_size)
+{
+  uint64 root = 0;
+
+  /* Integer square root, one bit at a time from the top ... */
+  for (uint64 bit = 1ULL << 31; bit != 0; bit >>= 1) {
+    uint64 trial = root | bit;
+
+    if (trial * trial <= request_size)
+      root = trial;
+  }
+
+  /* ... rounded up. */
+  return root * root < request_size ? root + 1 : root;
+}
+
+/* Transpose a full square in place, swapping tiles across the diagonal so
+ * that both tiles of a pair stay in cache.
+ */
+static void matrix_transpose(uint8* data, uint64 magnitude)
+{
+  for (uint64 row = 0; row < magnitude; row += MATRIX_TILE) {
+    uint64 row_end = row + MATRIX_TILE < magnitude ? row + MATRIX_TILE : magnitude;
+
+    for (uint64 col = row; col < magnitude; col += MATRIX_TILE) {
+      uint64 col_end = col + MATRIX_TILE < magnitude ? col + MATRIX_TILE : magnitude;
+
+      for (uint64 i = row; i < row_end; i++) {
+        /* On the diagonal only the cells above it are swapped. */
+        for (uint64 j = col == row ? i + 1 : col; j < col_end; j++) {
+          uint8 swap = data[i * magnitude + j];
+
+          data[i * magnitude + j] = data[j * magnitude + i];
+          data[j * magnitude + i] = swap;
+        }
+      }
+    }
+  }
+}
+
+/* Where the byte at row-major position p goes in column order. The first
+ * fill columns hold rows + 1 bytes, the others rows.
+ */
+static uint64 matrix_column_position(uint64 p, uint64 magnitude, uint64 rows, uint64 fill)
+{
+  uint64 i = p / magnitude;
+  uint64 j = p % magnitude;
+
+  return j * rows + (j < fill ? j : fill) + i;
+}
+
+/* Where the byte at column-order position q came from. */
+static uint64 matrix_row_position(uint64 q, uint64 magnitude, uint64 rows, uint64 fill)
 {
-  uint32 magnitude = 1;
+  uint64 tall = fill * (rows + 1);
+  uint64 i;
+  uint64 j;
 
-  if (request_size == 0)
-    return 0;
+  if (q < tall) {
+    j = q / (rows + 1);
+    i = q % (rows + 1);
+  }
+  else {
+    j = fill + (q - tall) / rows;
+    i = (q - tall) % rows;
+  }
+
+  return i * magnitude + j;
+}
+
+/* Apply a permutation in place by walking each of its cycles once. */
+static void matrix_permute(matrix_t* matrix, int shuffle)
+{
+  uint64 length    = matrix->length;
+  uint64 magnitude = matrix->magnitude;
+  uint64 rows      = length / magnitude;
+  uint64 fill      = length % magnitude;
+  uint8* visited   = (uint8*) calloc((length + 7) / 8, 1);
 
-  while (magnitude * magnitude < request_size)
-    magnitude++;
+  DEBUG_ASSERT(visited != NULL);
+
+  for (uint64 start = 0; start < length; start++) {
+    if (visited[start / 8] & (1 << start % 8))
+      continue;
+
+    uint8  carry = matrix->data[start];
+    uint64 p     = start;
+
+    do {
+      p = shuffle ? matrix_column_position(p, magnitude, rows, fill) : matrix_row_position(p, magnitude, rows, fill);
+
+      uint8 swap = matrix->data[p];
+
+      matrix->data[p] = carry;
+      carry           = swap;
+      visited[p / 8] |= 1 << p % 8;
+    } while (p != start);
+  }
+
+  free(visited);
+}
+
+void matrix_shuffle(matrix_t* matrix)
+{
+  DEBUG_ASSERT(matrix != NULL);
+
+  uint64 magnitude = matrix->magnitude;
+  uint64 rows      = magnitude == 0 ? 0 : matrix->length / magnitude;
+  uint64 fill      = magnitude == 0 ? 0 : matrix->length % magnitude;
+
+  if (matrix->length < 2)
+    return;
+
+  if (magnitude * magnitude > matrix->capacity) {
+    matrix_permute(matrix, 1);
+    return;
+  }
+
+  /* Transpose the whole square, empty cells included; column j then starts
+   * row j and only needs to be moved up against column j - 1.
+   */
+  matrix_transpose(matrix->data, magnitude);
+
+  for (uint64 j = 0, out = 0; j < magnitude; j++) {
+    uint64 height = rows + (j < fill);
+
+    memmove(matrix->data + out, matrix->data + j * magnitude, height);
+    out += height;
+  }
+}
+
+void matrix_unshuffle(matrix_t* matrix)
+{
+  DEBUG_ASSERT(matrix != NULL);
+
+  uint64 magnitude = matrix->magnitude;
+  uint64 rows      = magnitude == 0 ? 0 : matrix->length / magnitude;
+  uint64 fill      = magnitude == 0 ? 0 : matrix->length % magnitude;
+
+  if (matrix->length < 2)
+    return;
+
+  if (magnitude * magnitude > matrix->capacity) {
+    matrix_permute(matrix, 0);
+    return;
+  }
+
+  /* Spread the columns back out to full rows, last first, and transpose. */
+  for (uint64 j = magnitude, out = matrix->length; j-- > 0;) {
+    uint64 height = rows + (j < fill);
+
+    out -= height;
+    memmove(matrix->data + j * magnitude, matrix->data + out, height);
+  }
 
-  return magnitude;
+  matrix_transpose(matrix->data, magnitude);
 }
 
 void matrix_print(matrix_t* matrix)
@@ -113,9 +300,9 @@ void matrix_print(matrix_t* matrix)
   DEBUG_ASSERT(matrix != NULL);
 
   fprintf(stderr, "matrix[] = {\n");
-  fprintf(stderr, "  length = %d\n", matrix->length);
-  fprintf(stderr, "  capacity = %d\n", matrix->capacity);
-  fprintf(stderr, "  magnitude = %d (%d^2^)\n", matrix->magnitude, matrix->magnitude * matrix->magnitude);
+  fprintf(stderr, "  length = %llu\n", matrix->length);
+  fprintf(stderr, "  capacity = %llu\n", matrix->capacity);
+  fprintf(stderr, "  magnitude = %llu (%llu^2^)\n", matrix->magnitude, matrix->magnitude * matrix->magnitude);
   fprintf(stderr, "  data = %p\n", matrix->data);
   fprintf(stderr, "}\n");
 }
\ No newline at end of file
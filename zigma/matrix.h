@@ -33,13 +33,13 @@
  */
 typedef struct matrix_t {
   /* Actual length of data block. */
-  uint32 length;
+  uint64 length;
 
   /* Maximum length of data block. */
-  uint32 capacity;
+  uint64 capacity;
 
   /* The square root of the length. */
-  uint32 magnitude;
+  uint64 magnitude;
 
   /* The data block. */
   uint8* data;
@@ -54,7 +54,7 @@ typedef struct matrix_t {
  *   @return The initialized matrix object.
  *   @note The matrix object will be allocated with a capacity of at least 1 MB.
  */
-matrix_t* matrix_init(matrix_t* matrix, uint32 size_request);
+matrix_t* matrix_init(matrix_t* matrix, uint64 size_request);
 
 /* Destroys a matrix object.
  *   @param matrix The matrix structure to securely destroy.
@@ -62,6 +62,18 @@ matrix_t* matrix_init(matrix_t* matrix, uint32 size_request);
  */
 matrix_t* matrix_destroy(matrix_t* matrix);
 
+/* Data blocks of this size and up are backed by transparent hugepages. */
+#define MATRIX_HUGEPAGE (2 * 1024 * 1024)
+
+/* Makes room for at least size_request bytes without changing the length.
+ * The capacity at least doubles whenever it grows, so that filling a matrix
+ * piece by piece takes a handful of allocations; the old block is wiped.
+ *   @param matrix The matrix object to grow.
+ *   @param size_request The number of bytes the matrix must be able to hold.
+ *   @return The matrix object.
+ */
+matrix_t* matrix_reserve(matrix_t* matrix, uint64 size_request);
+
 /* Resizes a matrix object to at least size_request bytes. If the matrix is
  * already large enough, it will not be resized.
  *   @param matrix The matrix object to resize.
@@ -69,15 +81,33 @@ matrix_t* matrix_destroy(matrix_t* matrix);
  *   @return The resized matrix object.
  *   @note The matrix object will be allocated with a capacity of at least 1 MB.
  */
-matrix_t* matrix_resize(matrix_t* matrix, uint32 size_request);
+matrix_t* matrix_resize(matrix_t* matrix, uint64 size_request);
 
 /* Find the smallest value for which the square will contain request_size.
- * This is used to determine the size of the matrix. Ideally this could be
- * done with a square root, but that would require a floating point library.
+ * This is used to determine the size of the matrix. It is an integer square
+ * root, rounded up, so it needs no floating point library.
  *   @param request_size The number of bytes to be stored in the matrix.
  *   @return The smallest value for which the square will contain request_size.
  */
-uint32 matrix_smallest_magnitude(uint32 request_size);
+uint64 matrix_smallest_magnitude(uint64 request_size);
+
+/* Side of the square tiles moved as a unit by the transposition. */
+#define MATRIX_TILE 64
+
+/* Reshuffles the data from row order to column order: the length bytes are
+ * laid out row by row in a magnitude x magnitude square and read back column
+ * by column, skipping the empty cells of a partially filled square.
+ * The square is transposed in place a tile at a time. When the capacity is
+ * too small to hold the whole square, the permutation is applied by
+ * following its cycles instead, which is slower on large data.
+ *   @param matrix The matrix object to reshuffle.
+ */
+void matrix_shuffle(matrix_t* matrix);
+
+/* Reverses matrix_shuffle().
+ *   @param matrix The matrix object to restore.
+ */
+void matrix_unshuffle(matrix_t* matrix);
 
 void matrix_print(matrix_t* matrix);
 
@@ -0,0 +1,212 @@
+/*
+ * ZIGMA, Copyright (C) 1999, 2005, 2023 Chase Zehl O'Byrne
+ *  <mail: zehl@live.com> http://zehlchen.com/
+ *
+ * This file is part of ZIGMA.
+ *
+ * ZIGMA is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ZIGMA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ZIGMA; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pipeline.h"
+#include "zigma.h"
+
+static void ring_init(ring_t* ring)
+{
+  atomic_init(&ring->tail, 0);
+  atomic_init(&ring->waiting, 0);
+
+  ring->head = 0;
+
+  pthread_mutex_init(&ring->lock, NULL);
+  pthread_cond_init(&ring->wake, NULL);
+}
+
+static void ring_destroy(ring_t* ring)
+{
+  pthread_mutex_destroy(&ring->lock);
+  pthread_cond_destroy(&ring->wake);
+}
+
+static void ring_push(ring_t* ring, uint32 slot)
+{
+  uint32 tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+  ring->slots[tail % PIPELINE_BUFFERS] = slot;
+
+  /* Publish the slot, then wake the consumer only if it went to sleep. */
+  atomic_store(&ring->tail, tail + 1);
+
+  if (atomic_load(&ring->waiting)) {
+    pthread_mutex_lock(&ring->lock);
+    pthread_cond_signal(&ring->wake);
+    pthread_mutex_unlock(&ring->lock);
+  }
+}
+
+static uint32 ring_pop(ring_t* ring)
+{
+  uint32 head = ring->head;
+
+  if (atomic_load(&ring->tail) == head) {
+    pthread_mutex_lock(&ring->lock);
+    atomic_store(&ring->waiting, 1);
+
+    while (atomic_load(&ring->tail) == head)
+      pthread_cond_wait(&ring->wake, &ring->lock);
+
+    atomic_store(&ring->waiting, 0);
+    pthread_mutex_unlock(&ring->lock);
+  }
+
+  ring->head = head + 1;
+
+  return ring->slots[head % PIPELINE_BUFFERS];
+}
+
+/* An empty read marks the end of the input and, passed on as the last
+ * block, stops every stage. Work may empty a block before that.
+ */
+static void* pipeline_reader(void* arg)
+{
+  pipeline_t* pipeline = arg;
+  uint32      length;
+
+  /* A buffer belongs to the next stage once it is pushed, so only the local
+   * copy of its length may be looked at afterwards.
+   */
+  do {
+    uint32 slot = ring_pop(&pipeline->empty);
+
+    length = pipeline->read(pipeline->arg, pipeline->data[slot], pipeline->size);
+
+    pipeline->length[slot] = length;
+    pipeline->last[slot]   = length == 0;
+    pipeline->total += length;
+
+    ring_push(&pipeline->filled, slot);
+  } while (length != 0);
+
+  return NULL;
+}
+
+static void* pipeline_worker(void* arg)
+{
+  pipeline_t* pipeline = arg;
+  int         last;
+
+  do {
+    uint32 slot = ring_pop(&pipeline->filled);
+
+    last = pipeline->last[slot];
+
+    if (!last)
+      pipeline->length[slot] = pipeline->work(pipeline->arg, pipeline->data[slot], pipeline->length[slot]);
+
+    ring_push(&pipeline->done, slot);
+  } while (!last);
+
+  return NULL;
+}
+
+uint64 pipeline_run(uint32 size, pipeline_read_t* read, pipeline_work_t* work, pipeline_stage_t* write, void* arg)
+{
+  pipeline_t pipeline;
+  pthread_t  reader;
+  pthread_t  worker;
+  uint32     count;
+
+  pipeline.read  = read;
+  pipeline.work  = work;
+  pipeline.write = write;
+  pipeline.arg   = arg;
+  pipeline.size  = size;
+  pipeline.total = 0;
+
+  for (uint32 i = 0; i < PIPELINE_BUFFERS; i++) {
+    pipeline.data[i] = (uint8*) malloc(size);
+
+    DEBUG_ASSERT(pipeline.data[i] != NULL);
+  }
+
+  ring_init(&pipeline.empty);
+  ring_init(&pipeline.filled);
+  ring_init(&pipeline.done);
+
+  for (uint32 i = 0; i < PIPELINE_BUFFERS; i++)
+    ring_push(&pipeline.empty, i);
+
+  if (pthread_create(&reader, NULL, pipeline_reader, &pipeline) != 0) {
+    fprintf(stderr, "WARNING: pthread_create(): running the pipeline serially\n");
+
+    while ((count = read(arg, pipeline.data[0], size)) > 0) {
+      pipeline.total += count;
+
+      count = work(arg, pipeline.data[0], count);
+
+      if (write != NULL && count != 0)
+        write(arg, pipeline.data[0], count);
+    }
+  }
+  else {
+    /* Without a worker thread the caller does the work as well. */
+    int threaded = pthread_create(&worker, NULL, pipeline_worker, &pipeline) == 0;
+
+    while (1) {
+      uint32 slot;
+
+      if (threaded) {
+        slot = ring_pop(&pipeline.done);
+      }
+      else {
+        slot = ring_pop(&pipeline.filled);
+
+        if (!pipeline.last[slot])
+          pipeline.length[slot] = work(arg, pipeline.data[slot], pipeline.length[slot]);
+      }
+
+      if (pipeline.last[slot])
+        break;
+
+      if (write != NULL && pipeline.length[slot] != 0)
+        write(arg, pipeline.data[slot], pipeline.length[slot]);
+
+      ring_push(&pipeline.empty, slot);
+    }
+
+    pthread_join(reader, NULL);
+
+    if (threaded)
+      pthread_join(worker, NULL);
+  }
+
+  ring_destroy(&pipeline.empty);
+  ring_destroy(&pipeline.filled);
+  ring_destroy(&pipeline.done);
+
+  /* The buffers held plaintext. */
+  for (uint32 i = 0; i < PIPELINE_BUFFERS; i++) {
+    memnull(pipeline.data[i], size);
+    free(pipeline.data[i]);
+  }
+
+  return pipeline.total;
+}
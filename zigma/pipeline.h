@@ -0,0 +1,111 @@
+/*
+ * ZIGMA, Copyright (C) 1999, 2005, 2023 Chase Zehl O'Byrne
+ *  <mail: zehl@live.com> http://zehlchen.com/
+ *
+ * This file is part of ZIGMA.
+ *
+ * ZIGMA is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ZIGMA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ZIGMA; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#pragma once
+#ifndef _ZIGMA_PIPELINE_H_
+#define _ZIGMA_PIPELINE_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "zigma.h"
+
+/* Number of recycled buffers shared by the stages of a pipeline. */
+#define PIPELINE_BUFFERS 4
+
+/* Reads the next block of input.
+ *   @param arg The opaque argument given to pipeline_run().
+ *   @param data The buffer to fill.
+ *   @param size The size of the buffer in bytes.
+ *   @return The number of bytes read, 0 at the end of the input.
+ */
+typedef uint32(pipeline_read_t)(void* arg, uint8* data, uint32 size);
+
+/* Processes a block in place.
+ *   @param arg The opaque argument given to pipeline_run().
+ *   @param data The block.
+ *   @param size The size of the block in bytes, never 0.
+ *   @return The size of the processed block, at most size; it may be 0.
+ */
+typedef uint32(pipeline_work_t)(void* arg, uint8* data, uint32 size);
+
+/* Writes a block out.
+ *   @param arg The opaque argument given to pipeline_run().
+ *   @param data The block.
+ *   @param size The size of the block in bytes, never 0.
+ */
+typedef void(pipeline_stage_t)(void* arg, uint8* data, uint32 size);
+
+/* A single-producer, single-consumer queue of buffer numbers. It never fills
+ * up because it can hold every buffer of the pipeline at once.
+ */
+typedef struct ring_t {
+  uint32 slots[PIPELINE_BUFFERS];
+
+  /* Written by the producer only. */
+  atomic_uint tail;
+
+  /* Read and written by the consumer only. */
+  uint32 head;
+
+  /* Set while the consumer sleeps on an empty ring. */
+  atomic_int      waiting;
+  pthread_mutex_t lock;
+  pthread_cond_t  wake;
+} ring_t;
+
+/* Three stages connected by rings: read -> work -> write -> read. */
+typedef struct pipeline_t {
+  pipeline_read_t*  read;
+  pipeline_work_t*  work;
+  pipeline_stage_t* write;
+  void*             arg;
+
+  /* The buffers, the number of bytes in each and the end-of-input marks. */
+  uint8* data[PIPELINE_BUFFERS];
+  uint32 length[PIPELINE_BUFFERS];
+  int    last[PIPELINE_BUFFERS];
+  uint32 size;
+
+  /* Bytes read so far, updated by the reader. */
+  uint64 total;
+
+  /* Empty buffers, read buffers and processed buffers. */
+  ring_t empty;
+  ring_t filled;
+  ring_t done;
+} pipeline_t;
+
+/* Runs read, work and write on their own threads so that input, processing
+ * and output overlap. Blocks are passed on in order and every block goes
+ * through the three stages exactly once.
+ *   @param size The size of each buffer in bytes.
+ *   @param read Reads the input, on the reader thread.
+ *   @param work Processes a block, on the worker thread; it may shrink it.
+ *   @param write Writes a block, on the calling thread, or NULL.
+ *   @param arg The opaque argument passed to all three stages.
+ *   @return The total number of bytes read.
+ *   @note The stages run serially if the threads cannot be started.
+ */
+uint64 pipeline_run(uint32 size, pipeline_read_t* read, pipeline_work_t* work, pipeline_stage_t* write, void* arg);
+
+#endif /* _ZIGMA_PIPELINE_H_ */
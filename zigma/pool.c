@@ -0,0 +1,325 @@
+/*
+ * ZIGMA, Copyright (C) 1999, 2005, 2023 Chase Zehl O'Byrne
+ *  <mail: zehl@live.com> http://zehlchen.com/
+ *
+ * This file is part of ZIGMA.
+ *
+ * ZIGMA is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ZIGMA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ZIGMA; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pool.h"
+#include "zigma.h"
+
+uint32 pool_default_threads(void)
+{
+  long online = sysconf(_SC_NPROCESSORS_ONLN);
+
+  return online > 0 ? (uint32) online : 1;
+}
+
+/* Hand out indexes of the current batch until it is exhausted. */
+static void pool_drain(pool_t* pool)
+{
+  pthread_mutex_lock(&pool->lock);
+
+  while (pool->next < pool->count) {
+    uint32      index = pool->next++;
+    pool_job_t* job   = pool->job;
+    void*       arg   = pool->arg;
+
+    pthread_mutex_unlock(&pool->lock);
+    job(arg, index);
+    pthread_mutex_lock(&pool->lock);
+
+    if (++pool->finished == pool->count)
+      pthread_cond_broadcast(&pool->done);
+  }
+
+  pthread_mutex_unlock(&pool->lock);
+}
+
+/* The deque of the calling thread: its own for a worker, the first one for
+ * any other thread.
+ */
+static _Thread_local pool_t* pool_current;
+static _Thread_local uint32  pool_slot;
+
+static uint32 pool_self(pool_t* pool)
+{
+  return pool_current == pool ? pool_slot : 0;
+}
+
+static void pool_push(pool_deque_t* deque, pool_task_t* task, void* arg)
+{
+  pthread_mutex_lock(&deque->lock);
+
+  if (deque->count == deque->capacity) {
+    uint32        capacity = deque->capacity ? deque->capacity * 2 : 64;
+    pool_task_t** tasks    = (pool_task_t**) malloc(capacity * sizeof(pool_task_t*));
+    void**        args     = (void**) malloc(capacity * sizeof(void*));
+
+    DEBUG_ASSERT(tasks != NULL && args != NULL);
+
+    for (uint32 i = 0; i < deque->count; i++) {
+      tasks[i] = deque->tasks[(deque->top + i) % deque->capacity];
+      args[i]  = deque->args[(deque->top + i) % deque->capacity];
+    }
+
+    free(deque->tasks);
+    free(deque->args);
+
+    deque->tasks    = tasks;
+    deque->args     = args;
+    deque->capacity = capacity;
+    deque->top      = 0;
+  }
+
+  deque->tasks[(deque->top + deque->count) % deque->capacity] = task;
+  deque->args[(deque->top + deque->count) % deque->capacity]  = arg;
+  deque->count++;
+
+  pthread_mutex_unlock(&deque->lock);
+}
+
+/* Take the newest task of a deque (own) or the oldest (steal). */
+static int pool_take(pool_deque_t* deque, int steal, pool_task_t** task, void** arg)
+{
+  int found = 0;
+
+  pthread_mutex_lock(&deque->lock);
+
+  if (deque->count > 0) {
+    uint32 at = steal ? deque->top : (deque->top + deque->count - 1) % deque->capacity;
+
+    *task = deque->tasks[at];
+    *arg  = deque->args[at];
+    found = 1;
+
+    if (steal)
+      deque->top = (deque->top + 1) % deque->capacity;
+
+    deque->count--;
+  }
+
+  pthread_mutex_unlock(&deque->lock);
+
+  return found;
+}
+
+/* Run one task, from the own deque if possible, stolen otherwise.
+ *   @return 1 if a task was run, 0 if there was none to be found.
+ */
+static int pool_run_task(pool_t* pool)
+{
+  uint32       deques = pool->threads + 1;
+  uint32       self   = pool_self(pool);
+  pool_task_t* task;
+  void*        arg;
+
+  if (atomic_load(&pool->queued) == 0)
+    return 0;
+
+  for (uint32 n = 0; n < deques; n++) {
+    if (!pool_take(&pool->deques[(self + n) % deques], n != 0, &task, &arg))
+      continue;
+
+    atomic_fetch_sub(&pool->queued, 1);
+    task(arg);
+
+    /* The last task wakes up whoever waits for the tree to finish. */
+    if (atomic_fetch_sub(&pool->pending, 1) == 1) {
+      pthread_mutex_lock(&pool->lock);
+      pthread_cond_broadcast(&pool->wake);
+      pthread_mutex_unlock(&pool->lock);
+    }
+
+    return 1;
+  }
+
+  return 0;
+}
+
+static void* pool_worker(void* arg)
+{
+  pool_t* pool = arg;
+  uint32  seen = 0;
+
+  pool_current = pool;
+  pool_slot    = atomic_fetch_add(&pool->started, 1) + 1;
+
+  while (1) {
+    pthread_mutex_lock(&pool->lock);
+
+    while (!pool->stop && pool->generation == seen && atomic_load(&pool->queued) == 0)
+      pthread_cond_wait(&pool->wake, &pool->lock);
+
+    if (pool->stop) {
+      pthread_mutex_unlock(&pool->lock);
+      return NULL;
+    }
+
+    if (pool->generation != seen) {
+      seen = pool->generation;
+      pthread_mutex_unlock(&pool->lock);
+
+      pool_drain(pool);
+      continue;
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+
+    while (pool_run_task(pool))
+      ;
+  }
+}
+
+pool_t* pool_create(uint32 threads)
+{
+  pool_t* pool = (pool_t*) malloc(sizeof(pool_t));
+
+  DEBUG_ASSERT(pool != NULL);
+
+  memset(pool, 0, sizeof(pool_t));
+
+  if (threads == 0)
+    threads = pool_default_threads();
+
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->wake, NULL);
+  pthread_cond_init(&pool->done, NULL);
+
+  /* The thread calling pool_for() is one of the threads of execution. */
+  pool->threads = threads - 1;
+  pool->workers = (pthread_t*) malloc((pool->threads + 1) * sizeof(pthread_t));
+  pool->deques  = (pool_deque_t*) calloc(threads, sizeof(pool_deque_t));
+
+  DEBUG_ASSERT(pool->workers != NULL && pool->deques != NULL);
+
+  for (uint32 i = 0; i < threads; i++)
+    pthread_mutex_init(&pool->deques[i].lock, NULL);
+
+  for (uint32 i = 0; i < pool->threads; i++) {
+    if (pthread_create(&pool->workers[i], NULL, pool_worker, pool) != 0) {
+      fprintf(stderr, "WARNING: pthread_create(): running with %u threads\n", i + 1);
+      pool->threads = i;
+      break;
+    }
+  }
+
+  return pool;
+}
+
+void pool_for(pool_t* pool, uint32 count, pool_job_t* job, void* arg)
+{
+  if (pool == NULL || pool->threads == 0 || count < 2) {
+    for (uint32 i = 0; i < count; i++)
+      job(arg, i);
+
+    return;
+  }
+
+  pthread_mutex_lock(&pool->lock);
+
+  pool->job      = job;
+  pool->arg      = arg;
+  pool->count    = count;
+  pool->next     = 0;
+  pool->finished = 0;
+  pool->generation++;
+
+  pthread_cond_broadcast(&pool->wake);
+  pthread_mutex_unlock(&pool->lock);
+
+  pool_drain(pool);
+
+  pthread_mutex_lock(&pool->lock);
+
+  while (pool->finished < pool->count)
+    pthread_cond_wait(&pool->done, &pool->lock);
+
+  pthread_mutex_unlock(&pool->lock);
+}
+
+void pool_submit(pool_t* pool, pool_task_t* task, void* arg)
+{
+  if (pool == NULL) {
+    task(arg);
+    return;
+  }
+
+  atomic_fetch_add(&pool->pending, 1);
+  pool_push(&pool->deques[pool_self(pool)], task, arg);
+  atomic_fetch_add(&pool->queued, 1);
+
+  pthread_mutex_lock(&pool->lock);
+  pthread_cond_broadcast(&pool->wake);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+void pool_wait(pool_t* pool)
+{
+  if (pool == NULL)
+    return;
+
+  while (atomic_load(&pool->pending) > 0) {
+    if (pool_run_task(pool))
+      continue;
+
+    /* Everything left is running elsewhere; wake up for new tasks or the end. */
+    pthread_mutex_lock(&pool->lock);
+
+    while (atomic_load(&pool->pending) > 0 && atomic_load(&pool->queued) == 0)
+      pthread_cond_wait(&pool->wake, &pool->lock);
+
+    pthread_mutex_unlock(&pool->lock);
+  }
+}
+
+pool_t* pool_destroy(pool_t* pool)
+{
+  if (pool == NULL)
+    return NULL;
+
+  pthread_mutex_lock(&pool->lock);
+  pool->stop = 1;
+  pthread_cond_broadcast(&pool->wake);
+  pthread_mutex_unlock(&pool->lock);
+
+  for (uint32 i = 0; i < pool->threads; i++)
+    pthread_join(pool->workers[i], NULL);
+
+  pthread_mutex_destroy(&pool->lock);
+  pthread_cond_destroy(&pool->wake);
+  pthread_cond_destroy(&pool->done);
+
+  for (uint32 i = 0; i <= pool->threads; i++) {
+    pthread_mutex_destroy(&pool->deques[i].lock);
+    free(pool->deques[i].tasks);
+    free(pool->deques[i].args);
+  }
+
+  free(pool->deques);
+  free(pool->workers);
+  free(pool);
+
+  return NULL;
+}
@@ -0,0 +1,135 @@
+/*
+ * ZIGMA, Copyright (C) 1999, 2005, 2023 Chase Zehl O'Byrne
+ *  <mail: zehl@live.com> http://zehlchen.com/
+ *
+ * This file is part of ZIGMA.
+ *
+ * ZIGMA is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ZIGMA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ZIGMA; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#pragma once
+#ifndef _ZIGMA_POOL_H_
+#define _ZIGMA_POOL_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "zigma.h"
+
+/* A job run by the pool for each index of a batch.
+ *   @param arg The opaque argument given to pool_for().
+ *   @param index The index of the item to process.
+ */
+typedef void(pool_job_t)(void* arg, uint32 index);
+
+/* A task submitted with pool_submit(); it may submit further tasks.
+ *   @param arg The opaque argument given to pool_submit().
+ */
+typedef void(pool_task_t)(void* arg);
+
+/* The tasks of one thread of execution. The owner pushes and pops at the
+ * bottom (newest first), idle threads steal from the top (oldest first).
+ */
+typedef struct pool_deque_t {
+  pthread_mutex_t lock;
+
+  /* A ring of capacity slots holding count tasks from top on. */
+  pool_task_t** tasks;
+  void**        args;
+  uint32        capacity;
+  uint32        top;
+  uint32        count;
+} pool_deque_t;
+
+/* A fixed set of worker threads that process batches of indexed jobs and
+ * trees of tasks.
+ */
+typedef struct pool_t {
+  /* Number of worker threads (the caller of pool_for() also helps). */
+  uint32 threads;
+
+  /* The worker threads. */
+  pthread_t* workers;
+
+  pthread_mutex_t lock;
+  pthread_cond_t  wake;
+  pthread_cond_t  done;
+
+  /* The current batch: job(arg, i) for every i < count. */
+  pool_job_t* job;
+  void*       arg;
+  uint32      count;
+
+  /* Next index to hand out and number of finished indexes. */
+  uint32 next;
+  uint32 finished;
+
+  /* Incremented for every batch so sleeping workers notice new work. */
+  uint32 generation;
+
+  /* One task deque per thread of execution, the caller's first. */
+  pool_deque_t* deques;
+
+  /* Tasks waiting in the deques, and tasks submitted but not yet finished. */
+  atomic_uint queued;
+  atomic_uint pending;
+
+  /* Hands out the deques of the workers as they start. */
+  atomic_uint started;
+
+  /* Set when the pool is shutting down. */
+  int stop;
+} pool_t;
+
+/* Number of online processors, at least 1. */
+uint32 pool_default_threads(void);
+
+/* Creates a pool with the given number of threads of execution.
+ *   @param threads Total threads including the caller, or 0 for all processors.
+ *   @return The new pool.
+ */
+pool_t* pool_create(uint32 threads);
+
+/* Runs job(arg, i) for every i in [0, count) and waits for completion.
+ * Indexes are handed out dynamically so uneven jobs balance themselves.
+ *   @param pool The pool to run on, or NULL to run serially.
+ *   @param count The number of indexes.
+ *   @param job The job to run.
+ *   @param arg The opaque argument passed to the job.
+ */
+void pool_for(pool_t* pool, uint32 count, pool_job_t* job, void* arg);
+
+/* Submits a task. It goes to the deque of the calling thread, where idle
+ * threads can steal it, and runs at the latest during pool_wait().
+ *   @param pool The pool to run on, or NULL to run the task right away.
+ *   @param task The task to run.
+ *   @param arg The opaque argument passed to the task.
+ */
+void pool_submit(pool_t* pool, pool_task_t* task, void* arg);
+
+/* Helps running tasks until every submitted task, and every task submitted
+ * by those, has finished.
+ *   @param pool The pool to wait for, or NULL.
+ */
+void pool_wait(pool_t* pool);
+
+/* Stops and joins the workers and frees the pool.
+ *   @param pool The pool to destroy.
+ *   @return NULL.
+ */
+pool_t* pool_destroy(pool_t* pool);
+
+#endif /* _ZIGMA_POOL_H_ */
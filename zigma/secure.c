@@ -0,0 +1,141 @@
+/*
+ * ZIGMA, Copyright (C) 1999, 2005, 2023 Chase Zehl O'Byrne
+ *  <mail: zehl@live.com> http://zehlchen.com/
+ *
+ * This file is part of ZIGMA.
+ *
+ * ZIGMA is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ZIGMA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ZIGMA; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "secure.h"
+#include "zigma.h"
+
+/* The shared arena: its slots and a bitmap of the ones in use. */
+static pthread_mutex_t secure_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint8*          secure_arena;
+static uint64          secure_used;
+static int             secure_warned;
+
+static uint64 secure_page(void)
+{
+  return (uint64) sysconf(_SC_PAGESIZE);
+}
+
+void secure_advise(void* ptr, uint64 size)
+{
+#ifdef MADV_DONTDUMP
+  if (ptr != NULL && size != 0)
+    madvise(ptr, size, MADV_DONTDUMP);
+#else
+  (void) ptr;
+  (void) size;
+#endif
+}
+
+/* Map size bytes between two guard pages and lock them. The memory is placed
+ * at the end of its pages, so that running off it hits the guard page.
+ */
+static uint8* secure_map(uint64 size)
+{
+  uint64 page  = secure_page();
+  uint64 pages = (size + page - 1) / page * page;
+  uint8* base  = mmap(NULL, pages + 2 * page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+  if (base == MAP_FAILED) {
+    fprintf(stderr, "ERROR: mmap(): unable to map %llu bytes of secure memory: %s\n", size, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  mprotect(base, page, PROT_NONE);
+  mprotect(base + page + pages, page, PROT_NONE);
+  secure_advise(base + page, pages);
+
+  if (mlock(base + page, pages) != 0 && !secure_warned) {
+    fprintf(stderr, "WARNING: mlock(): unable to lock secure memory: %s\n", strerror(errno));
+    secure_warned = 1;
+  }
+
+  return base + page + pages - size;
+}
+
+static void secure_unmap(uint8* ptr, uint64 size)
+{
+  uint64 page  = secure_page();
+  uint64 pages = (size + page - 1) / page * page;
+  uint8* start = ptr + size - pages;
+
+  memnull(ptr, size);
+  munlock(start, pages);
+  munmap(start - page, pages + 2 * page);
+}
+
+void* secure_alloc(uint32 size)
+{
+  /* Slots keep 16-byte alignment; so must mappings of their own. */
+  uint32 rounded = (size + 15) / 16 * 16;
+
+  if (rounded <= SECURE_SLOT) {
+    pthread_mutex_lock(&secure_lock);
+
+    if (secure_arena == NULL)
+      secure_arena = secure_map(SECURE_SLOT * SECURE_SLOTS);
+
+    for (uint32 slot = 0; slot < SECURE_SLOTS; slot++) {
+      if (!(secure_used & (1ULL << slot))) {
+        secure_used |= 1ULL << slot;
+        pthread_mutex_unlock(&secure_lock);
+
+        return secure_arena + slot * SECURE_SLOT;
+      }
+    }
+
+    pthread_mutex_unlock(&secure_lock);
+  }
+
+  /* Anonymous mappings start out zeroed, like the arena slots. */
+  return secure_map(rounded);
+}
+
+void secure_free(void* ptr, uint32 size)
+{
+  uint8* data    = ptr;
+  uint32 rounded = (size + 15) / 16 * 16;
+
+  if (data == NULL)
+    return;
+
+  pthread_mutex_lock(&secure_lock);
+
+  if (secure_arena != NULL && data >= secure_arena && data < secure_arena + SECURE_SLOT * SECURE_SLOTS) {
+    memnull(data, SECURE_SLOT);
+    secure_used &= ~(1ULL << (data - secure_arena) / SECURE_SLOT);
+
+    pthread_mutex_unlock(&secure_lock);
+    return;
+  }
+
+  pthread_mutex_unlock(&secure_lock);
+
+  secure_unmap(data, rounded);
+}
@@ -0,0 +1,59 @@
+/*
+ * ZIGMA, Copyright (C) 1999, 2005, 2023 Chase Zehl O'Byrne
+ *  <mail: zehl@live.com> http://zehlchen.com/
+ *
+ * This file is part of ZIGMA.
+ *
+ * ZIGMA is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ZIGMA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ZIGMA; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#pragma once
+#ifndef _ZIGMA_SECURE_H_
+#define _ZIGMA_SECURE_H_
+
+#include "zigma.h"
+
+/* Size of a slot in the shared arena; larger requests get their own mapping. */
+#define SECURE_SLOT 512
+
+/* Number of slots in the shared arena. */
+#define SECURE_SLOTS 64
+
+/* Allocates zeroed memory for secrets: key material and cipher states.
+ * Small requests share an arena, larger ones get a mapping of their own. Both
+ * sit between inaccessible guard pages, are locked into memory so that they
+ * are never swapped out, and are left out of core dumps.
+ *   @param size The number of bytes to allocate.
+ *   @return The memory, never NULL.
+ *   @note If the memory cannot be locked (see RLIMIT_MEMLOCK), a warning is
+ *         printed once and the memory is used unlocked.
+ */
+void* secure_alloc(uint32 size);
+
+/* Wipes and releases memory from secure_alloc().
+ *   @param ptr The memory, or NULL.
+ *   @param size The size given to secure_alloc().
+ */
+void secure_free(void* ptr, uint32 size);
+
+/* Leaves a large buffer out of core dumps. Bulk buffers are too big to be
+ * locked into memory, so this is all they get besides a wipe.
+ *   @param ptr The buffer, which must be page aligned.
+ *   @param size The size of the buffer in bytes.
+ */
+void secure_advise(void* ptr, uint64 size);
+
+#endif /* _ZIGMA_SECURE_H_ */
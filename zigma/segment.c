@@ -0,0 +1,122 @@
+/*
+ * ZIGMA, Copyright (C) 1999, 2005, 2023 Chase Zehl O'Byrne
+ *  <mail: zehl@live.com> http://zehlchen.com/
+ *
+ * This file is part of ZIGMA.
+ *
+ * ZIGMA is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ZIGMA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ZIGMA; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pool.h"
+#include "segment.h"
+#include "zigma.h"
+
+segment_header_t* segment_plan(segment_header_t* header, uint32 segment_size, uint64 length)
+{
+  DEBUG_ASSERT(header != NULL);
+  DEBUG_ASSERT(segment_size != 0);
+
+  header->segment_size  = segment_size;
+  header->segment_count = (uint32) ((length + segment_size - 1) / segment_size);
+  header->length        = length;
+
+  return header;
+}
+
+void segment_write_header(segment_header_t const* header, uint8* data)
+{
+  memcpy(data, SEGMENT_MAGIC, 8);
+  pack_uint32(data + 8, header->segment_size);
+  pack_uint32(data + 12, header->segment_count);
+  pack_uint64(data + 16, header->length);
+}
+
+int segment_read_header(segment_header_t* header, uint8 const* data, uint64 length)
+{
+  if (length < SEGMENT_HEADER_SIZE || memcmp(data, SEGMENT_MAGIC, 8) != 0)
+    return 0;
+
+  header->segment_size  = unpack_uint32(data + 8);
+  header->segment_count = unpack_uint32(data + 12);
+  header->length        = unpack_uint64(data + 16);
+
+  if (header->segment_size == 0)
+    return 0;
+
+  /* The count must be exactly what the size and length imply. */
+  if (header->segment_count != (header->length + header->segment_size - 1) / header->segment_size)
+    return 0;
+
+  return 1;
+}
+
+zigma_t* segment_derive(zigma_t* handle, zigma_t const* base, uint64 index)
+{
+  DEBUG_ASSERT(handle != NULL);
+  DEBUG_ASSERT(base != NULL);
+
+  zigma_clone(handle, base);
+
+  for (int i = 0; i < 8; i++)
+    zigma_encrypt_byte(handle, (index >> (8 * i)) & 0xFF);
+
+  for (int i = 255; i >= 0; i--)
+    zigma_encrypt_byte(handle, i);
+
+  return handle;
+}
+
+/* Work order shared by the segment jobs. */
+typedef struct segment_job_t {
+  zigma_t const*          base;
+  segment_header_t const* header;
+  uint8*                  data;
+  zigma_cb_t*             callback;
+} segment_job_t;
+
+static void segment_run(void* arg, uint32 index)
+{
+  segment_job_t* job    = arg;
+  uint64         offset = (uint64) index * job->header->segment_size;
+  uint64         size   = job->header->length - offset;
+  zigma_t        state;
+
+  if (size > job->header->segment_size)
+    size = job->header->segment_size;
+
+  segment_derive(&state, job->base, index);
+  job->callback(&state, job->data + offset, size);
+
+  memnull(&state, sizeof(zigma_t));
+}
+
+void segment_encrypt(pool_t* pool, zigma_t const* base, segment_header_t const* header, uint8* data)
+{
+  segment_job_t job = {base, header, data, zigma_encrypt};
+
+  pool_for(pool, header->segment_count, segment_run, &job);
+}
+
+void segment_decrypt(pool_t* pool, zigma_t const* base, segment_header_t const* header, uint8* data)
+{
+  segment_job_t job = {base, header, data, zigma_decrypt};
+
+  pool_for(pool, header->segment_count, segment_run, &job);
+}
@@ -0,0 +1,100 @@
+/*
+ * ZIGMA, Copyright (C) 1999, 2005, 2023 Chase Zehl O'Byrne
+ *  <mail: zehl@live.com> http://zehlchen.com/
+ *
+ * This file is part of ZIGMA.
+ *
+ * ZIGMA is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ZIGMA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ZIGMA; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#pragma once
+#ifndef _ZIGMA_SEGMENT_H_
+#define _ZIGMA_SEGMENT_H_
+
+#include "pool.h"
+#include "zigma.h"
+
+/* The segmented container starts with this magic ... */
+#define SEGMENT_MAGIC "ZIGMASEG"
+
+/* ... followed by the segment size (32 bits), the segment count (32 bits) and
+ * the total payload length (64 bits), all little-endian.
+ */
+#define SEGMENT_HEADER_SIZE 24
+
+/* Parameters of a segmented container. Every segment but the last holds
+ * exactly segment_size bytes and is enciphered with its own derived state.
+ */
+typedef struct segment_header_t {
+  /* Size of each segment in bytes. */
+  uint32 segment_size;
+
+  /* Number of segments. */
+  uint32 segment_count;
+
+  /* Total payload length in bytes. */
+  uint64 length;
+} segment_header_t;
+
+/* Fills in a header for a payload of the given length.
+ *   @param header The header to populate.
+ *   @param segment_size The size of each segment in bytes (non-zero).
+ *   @param length The total payload length in bytes.
+ *   @return The populated header.
+ */
+segment_header_t* segment_plan(segment_header_t* header, uint32 segment_size, uint64 length);
+
+/* Serializes a header into SEGMENT_HEADER_SIZE bytes.
+ *   @param header The header to serialize.
+ *   @param data The output buffer.
+ */
+void segment_write_header(segment_header_t const* header, uint8* data);
+
+/* Parses a header.
+ *   @param header The header to populate.
+ *   @param data The input buffer.
+ *   @param length The number of bytes available in data.
+ *   @return 1 if data starts with a well-formed header, 0 otherwise.
+ */
+int segment_read_header(segment_header_t* header, uint8 const* data, uint64 length);
+
+/* Derives the independent state of one segment from the keyed state.
+ * The segment index is absorbed into a copy of the keyed state, which is then
+ * advanced a full turn of the permutation vector, as zigma_hash_sign() does.
+ *   @param handle The zigma object to populate.
+ *   @param base The zigma object initialized with the key.
+ *   @param index The segment index.
+ *   @return The derived zigma object.
+ */
+zigma_t* segment_derive(zigma_t* handle, zigma_t const* base, uint64 index);
+
+/* Encrypt a payload segment by segment, in parallel.
+ *   @param pool The pool to run on, or NULL to run serially.
+ *   @param base The zigma object initialized with the key (not modified).
+ *   @param header The container parameters.
+ *   @param data The payload to encrypt in place (header->length bytes).
+ */
+void segment_encrypt(pool_t* pool, zigma_t const* base, segment_header_t const* header, uint8* data);
+
+/* Decrypt a payload segment by segment, in parallel.
+ *   @param pool The pool to run on, or NULL to run serially.
+ *   @param base The zigma object initialized with the key (not modified).
+ *   @param header The container parameters.
+ *   @param data The payload to decrypt in place (header->length bytes).
+ */
+void segment_decrypt(pool_t* pool, zigma_t const* base, segment_header_t const* header, uint8* data);
+
+#endif /* _ZIGMA_SEGMENT_H_ */
@@ -0,0 +1,482 @@
+/*
+ * ZIGMA, Copyright (C) 1999, 2005, 2023 Chase Zehl O'Byrne
+ *  <mail: zehl@live.com> http://zehlchen.com/
+ *
+ * This file is part of ZIGMA.
+ *
+ * ZIGMA is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ZIGMA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ZIGMA; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "base64.h"
+#include "context.h"
+#include "keycache.h"
+#include "matrix.h"
+#include "selftest.h"
+#include "zigma.h"
+
+/* Buffer sizes covering the unrolled body, its tails and large buffers. */
+static const uint32 selftest_sizes[] = {0, 1, 2, 3, 4, 5, 7, 8, 15, 16, 17, 255, 256, 768, 4099, 65536, 1048579};
+
+#define SELFTEST_SIZES (sizeof(selftest_sizes) / sizeof(selftest_sizes[0]))
+
+/* Fill a buffer with reproducible bytes drawn from a running zigma state. */
+static void selftest_fill(zigma_t* source, uint8* data, uint32 size)
+{
+  memset(data, 0, size);
+  zigma_encrypt_reference(source, data, size);
+}
+
+static uint32 selftest_check(char const* what, uint32 size, int passed)
+{
+  if (!passed)
+    fprintf(stderr, "FAIL: %s (%u bytes)\n", what, size);
+
+  return passed ? 0 : 1;
+}
+
+uint32 selftest_kernels(void)
+{
+  uint32  failures = 0;
+  uint32  largest  = selftest_sizes[SELFTEST_SIZES - 1];
+  uint8*  plain    = malloc(largest);
+  uint8*  bulk     = malloc(largest);
+  uint8*  ref      = malloc(largest);
+  zigma_t source;
+
+  DEBUG_ASSERT(plain != NULL && bulk != NULL && ref != NULL);
+
+  zigma_init_hash(&source);
+
+  for (uint32 n = 0; n < SELFTEST_SIZES; n++) {
+    uint32  size = selftest_sizes[n];
+    uint8   key[256];
+    uint32  keylen = 1 + n * 15 % 256;
+    zigma_t base;
+    zigma_t state_bulk;
+    zigma_t state_ref;
+
+    selftest_fill(&source, key, keylen);
+    selftest_fill(&source, plain, size);
+    zigma_init(&base, key, keylen);
+
+    /* Encipher with both and compare ciphertext and final state. */
+    memcpy(bulk, plain, size);
+    memcpy(ref, plain, size);
+    state_bulk = base;
+    state_ref  = base;
+
+    zigma_encrypt(&state_bulk, bulk, size);
+    zigma_encrypt_reference(&state_ref, ref, size);
+
+    failures += selftest_check("zigma_encrypt output", size, memcmp(bulk, ref, size) == 0);
+    failures += selftest_check("zigma_encrypt state", size, memcmp(&state_bulk, &state_ref, sizeof(zigma_t)) == 0);
+
+    /* Decipher with both; both must also restore the plaintext. */
+    state_bulk = base;
+    state_ref  = base;
+
+    zigma_decrypt(&state_bulk, bulk, size);
+    zigma_decrypt_reference(&state_ref, ref, size);
+
+    failures += selftest_check("zigma_decrypt output", size, memcmp(bulk, ref, size) == 0);
+    failures += selftest_check("zigma_decrypt state", size, memcmp(&state_bulk, &state_ref, sizeof(zigma_t)) == 0);
+    failures += selftest_check("zigma_decrypt round trip", size, memcmp(bulk, plain, size) == 0);
+
+    /* Absorbing must leave the data alone and end in the enciphering state. */
+    state_bulk = base;
+    state_ref  = base;
+
+    memcpy(ref, plain, size);
+    zigma_hash_update(&state_bulk, plain, size);
+    zigma_encrypt_reference(&state_ref, ref, size);
+
+    failures += selftest_check("zigma_hash_update state", size, memcmp(&state_bulk, &state_ref, sizeof(zigma_t)) == 0);
+
+    /* The out-of-place kernels must match the reference without touching their input. */
+    state_bulk = base;
+    state_ref  = base;
+
+    memcpy(ref, plain, size);
+    zigma_encrypt_copy(&state_bulk, plain, bulk, size);
+    zigma_encrypt_reference(&state_ref, ref, size);
+
+    failures += selftest_check("zigma_encrypt_copy output", size, memcmp(bulk, ref, size) == 0);
+    failures += selftest_check("zigma_encrypt_copy state", size, memcmp(&state_bulk, &state_ref, sizeof(zigma_t)) == 0);
+
+    state_bulk = base;
+
+    zigma_decrypt_copy(&state_bulk, ref, bulk, size);
+
+    failures += selftest_check("zigma_decrypt_copy round trip", size, memcmp(bulk, plain, size) == 0);
+  }
+
+  memnull(&source, sizeof(zigma_t));
+
+  free(plain);
+  free(bulk);
+  free(ref);
+
+  return failures;
+}
+
+/* Largest batch of messages the lockstep test hands over at once. */
+#define SELFTEST_LANES (ZIGMA_MULTI_MAX * 2 + 5)
+
+/* Check one batch of messages against zigma_encrypt() and zigma_decrypt().
+ * With mixed lengths the lanes are refilled as messages run out; with equal
+ * ones every lane runs to the end in the kernel for the batch size.
+ */
+static uint32 selftest_lockstep_batch(zigma_t* source, uint32 count, int mixed)
+{
+  uint32   failures = 0;
+  zigma_t  multi[SELFTEST_LANES];
+  zigma_t  single[SELFTEST_LANES];
+  zigma_t* handles[SELFTEST_LANES];
+  uint8*   data[SELFTEST_LANES];
+  uint8*   plain[SELFTEST_LANES];
+  uint32   sizes[SELFTEST_LANES];
+
+  DEBUG_ASSERT(count <= SELFTEST_LANES);
+
+  for (uint32 i = 0; i < count; i++) {
+    uint8 key[16];
+
+    selftest_fill(source, key, 16);
+    zigma_init(&multi[i], key, 1 + i % 16);
+
+    /* One empty message among the mixed ones, the rest never empty. */
+    single[i]  = multi[i];
+    handles[i] = &multi[i];
+    sizes[i]   = mixed ? (i == 3 ? 0 : 1 + selftest_sizes[(i * 7) % SELFTEST_SIZES] % 70000) : 4099;
+    data[i]    = malloc(sizes[i] + 1);
+    plain[i]   = malloc(sizes[i] + 1);
+
+    DEBUG_ASSERT(data[i] != NULL && plain[i] != NULL);
+
+    selftest_fill(source, plain[i], sizes[i]);
+    memcpy(data[i], plain[i], sizes[i]);
+  }
+
+  zigma_encrypt_multi(handles, data, sizes, count);
+
+  for (uint32 i = 0; i < count; i++) {
+    zigma_encrypt(&single[i], plain[i], sizes[i]);
+
+    failures += selftest_check("zigma_encrypt_multi output", sizes[i], memcmp(data[i], plain[i], sizes[i]) == 0);
+    failures += selftest_check("zigma_encrypt_multi state", sizes[i], memcmp(&multi[i], &single[i], sizeof(zigma_t)) == 0);
+  }
+
+  zigma_decrypt_multi(handles, data, sizes, count);
+
+  for (uint32 i = 0; i < count; i++) {
+    zigma_decrypt(&single[i], plain[i], sizes[i]);
+
+    failures += selftest_check("zigma_decrypt_multi output", sizes[i], memcmp(data[i], plain[i], sizes[i]) == 0);
+    failures += selftest_check("zigma_decrypt_multi state", sizes[i], memcmp(&multi[i], &single[i], sizeof(zigma_t)) == 0);
+
+    free(data[i]);
+    free(plain[i]);
+  }
+
+  return failures;
+}
+
+uint32 selftest_lockstep(void)
+{
+  /* The 16, 8 and 4 lane kernels, an odd lane count and refilled lanes. */
+  static const uint32 counts[] = {ZIGMA_MULTI_MAX, 8, 4, 5, SELFTEST_LANES};
+  uint32              failures = 0;
+  zigma_t             source;
+
+  zigma_init_hash(&source);
+
+  for (uint32 n = 0; n < sizeof(counts) / sizeof(counts[0]); n++) {
+    failures += selftest_lockstep_batch(&source, counts[n], 0);
+    failures += selftest_lockstep_batch(&source, counts[n], 1);
+  }
+
+  return failures;
+}
+
+uint32 selftest_keycache(void)
+{
+  uint32      failures = 0;
+  uint8       blob[ZIGMA_STATE_SIZE];
+  uint8       key[64];
+  zigma_t     source;
+  zigma_t     expect;
+  zigma_t     actual;
+  keycache_t* cache = keycache_init(NULL, 8);
+
+  zigma_init_hash(&source);
+  selftest_fill(&source, key, 64);
+  zigma_init(&expect, key, 64);
+
+  zigma_export(&expect, blob);
+  failures += selftest_check("zigma_import round trip", ZIGMA_STATE_SIZE,
+                             zigma_import(&actual, blob) != NULL && memcmp(&actual, &expect, sizeof(zigma_t)) == 0);
+
+  blob[5] = blob[6];
+  failures += selftest_check("zigma_import rejects a broken vektor", ZIGMA_STATE_SIZE, zigma_import(&actual, blob) == NULL);
+
+  /* Cycle more keys than the cache holds so that entries get evicted. */
+  for (uint32 round = 0; round < 3; round++) {
+    for (uint32 i = 0; i < 24; i++) {
+      key[0] = (uint8) i;
+
+      zigma_init(&expect, key, 1 + i);
+
+      /* The first fetch may run the key schedule, the second must not. */
+      for (uint32 repeat = 0; repeat < 2; repeat++) {
+        keycache_fetch(cache, &actual, key, 1 + i);
+
+        failures += selftest_check("keycache_fetch state", 1 + i, memcmp(&actual, &expect, sizeof(zigma_t)) == 0);
+      }
+    }
+  }
+
+  failures += selftest_check("keycache hits", (uint32) cache->hits, cache->hits == 3 * 24);
+
+  keycache_destroy(cache);
+
+  return failures;
+}
+
+/* Feed a context with pieces of uneven sizes, in place or into another buffer.
+ *   @return The total the context reported.
+ */
+static uint64 selftest_context_feed(zigma_context_t* context, uint8 const* input, uint8* output, uint32 size)
+{
+  for (uint32 offset = 0, piece = 1; offset < size; offset += piece, piece = piece * 3 % 1021) {
+    if (piece > size - offset)
+      piece = size - offset;
+
+    zigma_context_update(context, input + offset, output + offset, piece);
+  }
+
+  return context->length;
+}
+
+uint32 selftest_context(void)
+{
+  uint32          failures = 0;
+  uint32          largest  = selftest_sizes[SELFTEST_SIZES - 1];
+  uint8*          plain    = malloc(largest);
+  uint8*          whole    = malloc(largest);
+  uint8*          pieces   = malloc(largest);
+  uint8*          clear    = malloc(largest);
+  uint8           expect[ZIGMA_CHECKSUM_SIZE];
+  uint8           actual[ZIGMA_CHECKSUM_SIZE];
+  uint8           key[32];
+  zigma_t         source;
+  zigma_t         keyed;
+  zigma_t         state;
+  zigma_context_t context;
+
+  DEBUG_ASSERT(plain != NULL && whole != NULL && pieces != NULL && clear != NULL);
+
+  zigma_init_hash(&source);
+  selftest_fill(&source, key, 32);
+  zigma_init(&keyed, key, 32);
+
+  for (uint32 n = 0; n < SELFTEST_SIZES; n++) {
+    uint32 size = selftest_sizes[n];
+
+    selftest_fill(&source, plain, size);
+
+    /* Enciphering in pieces matches one zigma_encrypt() call, out of place and in place. */
+    memcpy(whole, plain, size);
+    zigma_encrypt(zigma_clone(&state, &keyed), whole, size);
+
+    for (uint32 inplace = 0; inplace < 2; inplace++) {
+      uint8 const* input = inplace ? pieces : plain;
+
+      memcpy(pieces, plain, size);
+      zigma_context_init(&context, ZIGMA_ENCRYPT, &keyed);
+
+      failures += selftest_check("zigma_context_update encrypt length", size, selftest_context_feed(&context, input, pieces, size) == size);
+      failures += selftest_check("zigma_context_final encrypt length", size, zigma_context_final(&context, NULL, 0) == size);
+      failures += selftest_check("zigma_context_update encrypt output", size, memcmp(pieces, whole, size) == 0);
+    }
+
+    /* Deciphering the ciphertext in pieces matches one zigma_decrypt() call. */
+    memcpy(clear, whole, size);
+    zigma_decrypt(zigma_clone(&state, &keyed), clear, size);
+
+    for (uint32 inplace = 0; inplace < 2; inplace++) {
+      uint8 const* input = inplace ? pieces : whole;
+
+      memcpy(pieces, whole, size);
+      zigma_context_init(&context, ZIGMA_DECRYPT, &keyed);
+
+      failures += selftest_check("zigma_context_update decrypt length", size, selftest_context_feed(&context, input, pieces, size) == size);
+      failures += selftest_check("zigma_context_final decrypt length", size, zigma_context_final(&context, NULL, 0) == size);
+      failures += selftest_check("zigma_context_update decrypt output", size, memcmp(pieces, clear, size) == 0);
+      failures += selftest_check("zigma_context_update decrypt round trip", size, memcmp(pieces, plain, size) == 0);
+    }
+
+    /* Hashing in pieces matches one zigma_hash_update() call and leaves the data alone. */
+    zigma_init_hash(&state);
+    zigma_hash_update(&state, plain, size);
+    zigma_hash_sign(&state, expect, ZIGMA_CHECKSUM_SIZE);
+
+    memcpy(pieces, plain, size);
+    zigma_context_init(&context, ZIGMA_HASH, NULL);
+
+    failures += selftest_check("zigma_context_update hash length", size, selftest_context_feed(&context, pieces, pieces, size) == size);
+    failures += selftest_check("zigma_context_final hash length", size, zigma_context_final(&context, actual, ZIGMA_CHECKSUM_SIZE) == size);
+    failures += selftest_check("zigma_context_final checksum", size, memcmp(actual, expect, ZIGMA_CHECKSUM_SIZE) == 0);
+    failures += selftest_check("zigma_context_update hash input", size, memcmp(pieces, plain, size) == 0);
+  }
+
+  memnull(&source, sizeof(zigma_t));
+  memnull(&keyed, sizeof(zigma_t));
+  memnull(&state, sizeof(zigma_t));
+
+  free(plain);
+  free(whole);
+  free(pieces);
+  free(clear);
+
+  return failures;
+}
+
+uint32 selftest_base64(void)
+{
+  uint32          failures = 0;
+  uint32          largest  = selftest_sizes[SELFTEST_SIZES - 1];
+  uint8*          plain    = malloc(largest);
+  char*           scalar   = malloc(largest / 3 * 4 + 8);
+  char*           vector   = malloc(largest / 3 * 4 + 8);
+  uint8*          decoded  = malloc(largest);
+  base64_kernel_t best     = base64_select(BASE64_AVX2);
+  zigma_t         source;
+
+  DEBUG_ASSERT(plain != NULL && scalar != NULL && vector != NULL && decoded != NULL);
+
+  zigma_init_hash(&source);
+
+  for (uint32 n = 0; n < SELFTEST_SIZES; n++) {
+    uint32 size = selftest_sizes[n];
+
+    selftest_fill(&source, plain, size);
+
+    base64_select(BASE64_SCALAR);
+
+    uint32 length = base64_encode(scalar, (char*) plain, size);
+
+    for (base64_kernel_t kernel = BASE64_SCALAR; kernel <= best; kernel++) {
+      base64_select(kernel);
+
+      failures += selftest_check("base64_encode output", size,
+                                 base64_encode(vector, (char*) plain, size) == length && memcmp(vector, scalar, length) == 0);
+      failures += selftest_check("base64_decode round trip", size,
+                                 base64_decode((char*) decoded, scalar, length) == size && memcmp(decoded, plain, size) == 0);
+
+      /* A stray character anywhere must be rejected, as the scalar code does. */
+      if (length > 0) {
+        char saved = scalar[length / 2];
+
+        scalar[length / 2] = '*';
+        failures += selftest_check("base64_decode rejects", size, base64_decode((char*) decoded, scalar, length) == 0);
+        scalar[length / 2] = saved;
+      }
+    }
+  }
+
+  base64_select(best);
+  memnull(&source, sizeof(zigma_t));
+
+  free(plain);
+  free(scalar);
+  free(vector);
+  free(decoded);
+
+  return failures;
+}
+
+uint32 selftest_shuffle(void)
+{
+  static const uint32 lengths[] = {0, 1, 2, 3, 5, 63, 64, 65, 100, 4095, 4096, 4097, 65535, 1048576, 1050000};
+
+  uint32   failures = 0;
+  uint32   largest  = lengths[sizeof(lengths) / sizeof(lengths[0]) - 1];
+  uint8*   plain    = malloc(largest);
+  uint8*   expect   = malloc(largest);
+  zigma_t  source;
+  matrix_t matrix;
+
+  DEBUG_ASSERT(plain != NULL && expect != NULL);
+
+  zigma_init_hash(&source);
+
+  for (uint32 n = 0; n < sizeof(lengths) / sizeof(lengths[0]); n++) {
+    uint32 length    = lengths[n];
+    uint32 magnitude = matrix_smallest_magnitude(length);
+
+    selftest_fill(&source, plain, length);
+
+    /* Read the square column by column, skipping the empty cells. */
+    for (uint32 j = 0, out = 0; j < magnitude; j++)
+      for (uint32 i = 0; i < magnitude; i++)
+        if ((uint64) i * magnitude + j < length)
+          expect[out++] = plain[i * magnitude + j];
+
+    /* Once with the whole square in the buffer and once without. */
+    for (uint32 cramped = 0; cramped < 2; cramped++) {
+      matrix_init(&matrix, length);
+      memcpy(matrix.data, plain, length);
+
+      if (cramped)
+        matrix.capacity = length;
+
+      matrix_shuffle(&matrix);
+      failures += selftest_check("matrix_shuffle output", length, memcmp(matrix.data, expect, length) == 0);
+
+      matrix_unshuffle(&matrix);
+      failures += selftest_check("matrix_unshuffle round trip", length, memcmp(matrix.data, plain, length) == 0);
+
+      free(matrix.data);
+    }
+  }
+
+  memnull(&source, sizeof(zigma_t));
+
+  free(plain);
+  free(expect);
+
+  return failures;
+}
+
+uint32 selftest_run(void)
+{
+  uint32 failures = 0;
+
+  failures += selftest_kernels();
+  failures += selftest_lockstep();
+  failures += selftest_keycache();
+  failures += selftest_context();
+  failures += selftest_base64();
+  failures += selftest_shuffle();
+
+  fprintf(stderr, "Self-test %s: %u failures\n", failures == 0 ? "passed" : "FAILED", failures);
+
+  return failures;
+}
@@ -0,0 +1,73 @@
+/*
+ * ZIGMA, Copyright (C) 1999, 2005, 2023 Chase Zehl O'Byrne
+ *  <mail: zehl@live.com> http://zehlchen.com/
+ *
+ * This file is part of ZIGMA.
+ *
+ * ZIGMA is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ZIGMA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ZIGMA; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#pragma once
+#ifndef _ZIGMA_SELFTEST_H_
+#define _ZIGMA_SELFTEST_H_
+
+#include "zigma.h"
+
+/* Cross-check the bulk cipher kernels against the reference implementation.
+ * Every buffer size in the sweep is enciphered and deciphered with both and
+ * the outputs and final states must match bit for bit.
+ *   @return The number of failed checks.
+ */
+uint32 selftest_kernels(void);
+
+/* Cross-check zigma_encrypt_multi() and zigma_decrypt_multi() against the
+ * single-state kernels for groups of messages of uneven sizes.
+ *   @return The number of failed checks.
+ */
+uint32 selftest_lockstep(void);
+
+/* Check zigma_export()/zigma_import() round trips and that states served by
+ * the key cache match a fresh key schedule, across evictions.
+ *   @return The number of failed checks.
+ */
+uint32 selftest_keycache(void);
+
+/* Check that the streaming context API, fed in uneven pieces both in place and
+ * into another buffer, matches whole-buffer zigma_encrypt(), zigma_decrypt()
+ * and hashing.
+ *   @return The number of failed checks.
+ */
+uint32 selftest_context(void);
+
+/* Check that every base64 kernel the processor supports encodes and decodes
+ * exactly like the scalar code, and rejects what it rejects.
+ *   @return The number of failed checks.
+ */
+uint32 selftest_base64(void);
+
+/* Check matrix_shuffle() against a naive column walk on full and partially
+ * filled squares, with and without room for the whole square, and that
+ * matrix_unshuffle() restores the data.
+ *   @return The number of failed checks.
+ */
+uint32 selftest_shuffle(void);
+
+/* Run every self-test and report the results on stderr.
+ *   @return The number of failed checks.
+ */
+uint32 selftest_run(void);
+
+#endif /* _ZIGMA_SELFTEST_H_ */
@@ -0,0 +1,161 @@
+/*
+ * ZIGMA, Copyright (C) 1999, 2005, 2023 Chase Zehl O'Byrne
+ *  <mail: zehl@live.com> http://zehlchen.com/
+ *
+ * This file is part of ZIGMA.
+ *
+ * ZIGMA is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ZIGMA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ZIGMA; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include "stats.h"
+#include "zigma.h"
+
+static char const* stats_names[STATS_PHASES] = {"key", "read", "codec", "cipher", "hash", "write"};
+
+int stats_enabled;
+
+static int           stats_json;
+static uint64        stats_started;
+static atomic_ullong stats_time[STATS_PHASES];
+static atomic_ullong stats_bytes[STATS_PHASES];
+
+#ifdef ZIGMA_STATS_WRAP
+
+/* Every allocation of the program, counted by the --wrap'ed allocators. */
+static atomic_ullong stats_allocations;
+static atomic_ullong stats_allocated;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+int   __real_posix_memalign(void** ptr, size_t alignment, size_t size);
+void* __real_mmap(void* addr, size_t length, int prot, int flags, int fd, off_t offset);
+
+static void stats_count(uint64 size)
+{
+  atomic_fetch_add_explicit(&stats_allocations, 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&stats_allocated, size, memory_order_relaxed);
+}
+
+void* __wrap_malloc(size_t size)
+{
+  stats_count(size);
+
+  return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size)
+{
+  stats_count(count * size);
+
+  return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size)
+{
+  stats_count(size);
+
+  return __real_realloc(ptr, size);
+}
+
+int __wrap_posix_memalign(void** ptr, size_t alignment, size_t size)
+{
+  stats_count(size);
+
+  return __real_posix_memalign(ptr, alignment, size);
+}
+
+void* __wrap_mmap(void* addr, size_t length, int prot, int flags, int fd, off_t offset)
+{
+  stats_count(length);
+
+  return __real_mmap(addr, length, prot, flags, fd, offset);
+}
+
+#endif
+
+void stats_start(char const* mode)
+{
+  if (*mode == 0 || strcmp(mode, "0") == 0)
+    return;
+
+#ifdef ZIGMA_STATS
+  stats_enabled = 1;
+  stats_json    = strcmp(mode, "json") == 0;
+  stats_started = stats_now();
+#else
+  fprintf(stderr, "WARNING: built without ZIGMA_STATS, ignoring 'stats=%s'\n", mode);
+#endif
+}
+
+uint64 stats_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void stats_add(stats_phase_t phase, uint64 since, uint64 bytes)
+{
+  atomic_fetch_add_explicit(&stats_time[phase], stats_now() - since, memory_order_relaxed);
+  atomic_fetch_add_explicit(&stats_bytes[phase], bytes, memory_order_relaxed);
+}
+
+void stats_report(void)
+{
+  if (!stats_enabled)
+    return;
+
+  struct rusage usage;
+  double        wall = (stats_now() - stats_started) / 1e9;
+
+  getrusage(RUSAGE_SELF, &usage);
+
+  fprintf(stderr, stats_json ? "{\"wall_s\": %.6f" : "STATS: wall %.6f s", wall);
+
+  for (int i = 0; i < STATS_PHASES; i++) {
+    double seconds = atomic_load(&stats_time[i]) / 1e9;
+    uint64 bytes   = atomic_load(&stats_bytes[i]);
+    double rate    = seconds > 0 ? bytes / seconds / 1e6 : 0;
+
+    if (stats_json)
+      fprintf(stderr, ", \"%s\": {\"s\": %.6f, \"bytes\": %llu, \"mb_per_s\": %.1f}", stats_names[i], seconds, bytes, rate);
+    else if (bytes > 0)
+      fprintf(stderr, ", %s %.6f s %llu B (%.1f MB/s)", stats_names[i], seconds, bytes, rate);
+    else if (seconds > 0)
+      fprintf(stderr, ", %s %.6f s", stats_names[i], seconds);
+  }
+
+  /* ru_maxrss is in kilobytes on Linux. */
+  fprintf(stderr, stats_json ? ", \"peak_rss_kb\": %ld" : ", peak RSS %ld KB", usage.ru_maxrss);
+
+#ifdef ZIGMA_STATS_WRAP
+  fprintf(stderr, stats_json ? ", \"allocations\": %llu, \"allocated_bytes\": %llu" : ", %llu allocations of %llu B",
+          (uint64) atomic_load(&stats_allocations), (uint64) atomic_load(&stats_allocated));
+#endif
+
+  fprintf(stderr, stats_json ? "}\n" : "\n");
+}
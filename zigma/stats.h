@@ -0,0 +1,83 @@
+/*
+ * ZIGMA, Copyright (C) 1999, 2005, 2023 Chase Zehl O'Byrne
+ *  <mail: zehl@live.com> http://zehlchen.com/
+ *
+ * This file is part of ZIGMA.
+ *
+ * ZIGMA is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ZIGMA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ZIGMA; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#pragma once
+#ifndef _ZIGMA_STATS_H_
+#define _ZIGMA_STATS_H_
+
+#include "zigma.h"
+
+/* The stages of a run that stats= accounts for. Stages on different threads
+ * overlap, so their times may add up to more than the wall clock time.
+ */
+typedef enum {
+  STATS_KEY = 0, /* the key schedule */
+  STATS_READ,    /* reading the input */
+  STATS_CODEC,   /* armor encoding and decoding */
+  STATS_CIPHER,  /* enciphering, deciphering and shuffling */
+  STATS_HASH,    /* hashing */
+  STATS_WRITE,   /* writing the output */
+  STATS_PHASES
+} stats_phase_t;
+
+#ifdef ZIGMA_STATS
+
+/* Set by stats_start() when a report was asked for. */
+extern int stats_enabled;
+
+/* Opens a timed section; the time is only taken when stats are enabled. */
+#define STATS_BEGIN(since) uint64 since = stats_enabled ? stats_now() : 0
+
+/* Closes a timed section, counting bytes against the phase. */
+#define STATS_END(phase, since, bytes) \
+  if (stats_enabled)                   \
+    stats_add(phase, since, bytes);
+
+#else
+
+#define STATS_BEGIN(since)
+#define STATS_END(phase, since, bytes)
+
+#endif
+
+/* Starts the wall clock and enables the timers.
+ *   @param mode "1" for a one-line summary, "json" for JSON, "0" or "" for none.
+ */
+void stats_start(char const* mode);
+
+/* The monotonic clock in nanoseconds. */
+uint64 stats_now(void);
+
+/* Accounts for a timed section; safe on any thread.
+ *   @param phase The stage the time and bytes belong to.
+ *   @param since When the section started, from stats_now().
+ *   @param bytes The bytes the section processed.
+ */
+void stats_add(stats_phase_t phase, uint64 since, uint64 bytes);
+
+/* Prints the report asked for by stats_start() to stderr, if any: the time and
+ * bytes of every stage, the wall clock time, the peak resident set size and
+ * the number of allocations.
+ */
+void stats_report(void);
+
+#endif /* _ZIGMA_STATS_H_ */
@@ -0,0 +1,311 @@
+/*
+ * ZIGMA, Copyright (C) 1999, 2005, 2023 Chase Zehl O'Byrne
+ *  <mail: zehl@live.com> http://zehlchen.com/
+ *
+ * This file is part of ZIGMA.
+ *
+ * ZIGMA is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ZIGMA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ZIGMA; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "checkpoint.h"
+#include "codec.h"
+#include "matrix.h"
+#include "pipeline.h"
+#include "segment.h"
+#include "stats.h"
+#include "stream.h"
+#include "window.h"
+#include "zigma.h"
+
+sint64 try_read_block(FILE* fp, uint8* data, uint32 size)
+{
+  ssize_t count;
+
+  do {
+    count = read(fileno(fp), data, size);
+  } while (count < 0 && errno == EINTR);
+
+  return count;
+}
+
+uint32 read_block(FILE* fp, uint8* data, uint32 size)
+{
+  sint64 count = try_read_block(fp, data, size);
+
+  if (count < 0) {
+    fprintf(stderr, "ERROR: read(): unable to read input: %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  return (uint32) count;
+}
+
+uint32 stream_decode(stream_t* stream, uint8* data, uint32 size)
+{
+  STATS_BEGIN(codec_time);
+
+  size = decoder_run(stream->decoder, data, size);
+
+  STATS_END(STATS_CODEC, codec_time, size);
+
+  if (stream->decoder->malformed)
+    stream->failed = 1;
+
+  return size;
+}
+
+int stream_report(stream_t const* stream, char const* name)
+{
+  if (!stream->failed)
+    return 0;
+
+  if (stream->error != 0 && name != NULL)
+    fprintf(stderr, "ERROR: read(): unable to read '%s': %s\n", name, strerror(stream->error));
+  else if (stream->error != 0)
+    fprintf(stderr, "ERROR: read(): unable to read input: %s\n", strerror(stream->error));
+  else if (name != NULL)
+    fprintf(stderr, "ERROR: the armored input '%s' is malformed\n", name);
+  else
+    fprintf(stderr, "ERROR: the armored input is malformed\n");
+
+  return 1;
+}
+
+/* Read up to size bytes of (decoded) input, pending bytes first, without
+ * waiting for a full buffer.
+ *   @return The number of bytes read, 0 only at the end of the input or after
+ *           an error.
+ */
+static uint32 stream_fill(stream_t* stream, uint8* data, uint32 size)
+{
+  uint32 count;
+
+  if (stream->failed)
+    return 0;
+
+  if (stream->spilled > 0) {
+    count = stream->spilled < size ? stream->spilled : size;
+
+    memcpy(data, stream->spill, count);
+    memmove(stream->spill, stream->spill + count, stream->spilled - count);
+    stream->spilled -= count;
+
+    return count;
+  }
+
+  do {
+    uint8  scratch[sizeof(stream->spill)];
+    uint8* target = data;
+    uint32 room   = size;
+
+    /* Completing a pending quartet yields up to two bytes more than were
+     * read, so leave room for them; small reads are decoded on the side.
+     */
+    if (stream->decoder != NULL && size < sizeof(scratch))
+      target = scratch;
+
+    if (stream->decoder != NULL)
+      room = (target == scratch ? sizeof(scratch) : size) - 2;
+
+    if (stream->pending_length > 0) {
+      count = stream->pending_length < room ? stream->pending_length : room;
+
+      memcpy(target, stream->pending, count);
+
+      stream->pending += count;
+      stream->pending_length -= count;
+    }
+    else {
+      STATS_BEGIN(read_time);
+
+      sint64 got = try_read_block(stream->input_fp, target, stream->limit < room ? stream->limit : room);
+
+      STATS_END(STATS_READ, read_time, got > 0 ? got : 0);
+
+      if (got < 0) {
+        stream->failed = 1;
+        stream->error  = errno;
+        return 0;
+      }
+
+      count = (uint32) got;
+      stream->limit -= count;
+    }
+
+    if (count == 0)
+      return 0;
+
+    /* A block of armor may be nothing but line breaks and comments. */
+    if (stream->decoder != NULL)
+      count = stream_decode(stream, target, count);
+
+    /* Nothing decoded from malformed armor goes any further. */
+    if (stream->failed)
+      return 0;
+
+    if (target == scratch && count > size) {
+      stream->spilled = count - size;
+      memcpy(stream->spill, scratch + size, stream->spilled);
+      count = size;
+    }
+
+    if (target == scratch)
+      memcpy(data, scratch, count);
+  } while (count == 0);
+
+  return count;
+}
+
+uint32 stream_read(void* arg, uint8* data, uint32 size)
+{
+  stream_t* stream = arg;
+  uint32    total  = 0;
+  uint32    count;
+
+  /* A shuffle window must arrive whole; anything else may come in pieces. */
+  do {
+    count = stream_fill(stream, data + total, size - total);
+    total += count;
+  } while (stream->window != 0 && count != 0 && total < size);
+
+  return total;
+}
+
+uint32 stream_work(void* arg, uint8* data, uint32 size)
+{
+  stream_t* stream = arg;
+
+  STATS_BEGIN(cipher_time);
+
+  if (stream->window != 0 && stream->inverse)
+    window_unshuffle(data, size, stream->window, stream->window);
+
+  if (stream->index != NULL)
+    checkpoint_process(stream->index, stream->ziggy, data, size, stream->callback);
+  else
+    stream->callback(stream->ziggy, data, size);
+
+  if (stream->window != 0 && !stream->inverse)
+    window_shuffle(data, size, stream->window, stream->window);
+
+  STATS_END(STATS_CIPHER, cipher_time, size);
+
+  return size;
+}
+
+void stream_write(void* arg, uint8* data, uint32 size)
+{
+  stream_t* stream = arg;
+  uint32    drop   = stream->lead < size ? stream->lead : size;
+  uint32    keep   = stream->count < size - drop ? stream->count : size - drop;
+
+  STATS_BEGIN(codec_time);
+
+  codec_write(stream->codec, data + drop, keep);
+
+  /* Raw output goes straight to the file. */
+  STATS_END(stream->codec->base == 256 ? STATS_WRITE : STATS_CODEC, codec_time, keep);
+  STATS_BEGIN(write_time);
+
+  codec_flush(stream->codec);
+
+  STATS_END(STATS_WRITE, write_time, 0);
+
+  stream->lead -= drop;
+  stream->count -= keep;
+}
+
+uint32 stream_hash(void* arg, uint8* data, uint32 size)
+{
+  STATS_BEGIN(hash_time);
+
+  zigma_hash_update(((stream_t*) arg)->ziggy, data, size);
+
+  STATS_END(STATS_HASH, hash_time, size);
+
+  return size;
+}
+
+uint64 stream_blocks(stream_t* stream)
+{
+  return pipeline_run(stream->window != 0 ? stream->window : 64 * 1024, stream_read, stream_work, stream_write, stream);
+}
+
+uint64 stream_serial(stream_t* stream)
+{
+  uint32 size  = stream->window != 0 ? stream->window : 64 * 1024;
+  uint8* data  = (uint8*) malloc(size);
+  uint64 total = 0;
+  uint32 count;
+
+  DEBUG_ASSERT(data != NULL);
+
+  while ((count = stream_read(stream, data, size)) > 0) {
+    total += count;
+    stream_write(stream, data, stream_work(stream, data, count));
+  }
+
+  memnull(data, size);
+  free(data);
+
+  return total;
+}
+
+uint64 stream_gather(stream_t* stream, matrix_t* matrix, uint64 total)
+{
+  uint32 count;
+
+  do {
+    matrix_reserve(matrix, total + 64 * 1024);
+
+    count = stream_fill(stream, matrix->data + total, 64 * 1024);
+    total += count;
+
+    matrix->length = total;
+  } while (count > 0);
+
+  matrix_resize(matrix, total);
+
+  return total;
+}
+
+uint32 stream_begin(stream_t* stream, matrix_t* container)
+{
+  uint8  start[WINDOW_HEADER_SIZE];
+  uint32 started = 0;
+  uint32 count;
+
+  while (started < sizeof(start) && (count = stream_fill(stream, start + started, sizeof(start) - started)) > 0)
+    started += count;
+
+  if (container != NULL && started >= 8 && memcmp(start, SEGMENT_MAGIC, 8) == 0) {
+    matrix_resize(container, started);
+    memcpy(container->data, start, started);
+  }
+  else if (!window_read_header(&stream->window, start, started)) {
+    stream_write(stream, start, stream_work(stream, start, started));
+  }
+
+  memnull(start, sizeof(start));
+
+  return started;
+}
@@ -0,0 +1,135 @@
+/*
+ * ZIGMA, Copyright (C) 1999, 2005, 2023 Chase Zehl O'Byrne
+ *  <mail: zehl@live.com> http://zehlchen.com/
+ *
+ * This file is part of ZIGMA.
+ *
+ * ZIGMA is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ZIGMA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ZIGMA; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#pragma once
+#ifndef _ZIGMA_STREAM_H_
+#define _ZIGMA_STREAM_H_
+
+#include <stdio.h>
+
+#include "checkpoint.h"
+#include "codec.h"
+#include "matrix.h"
+#include "zigma.h"
+
+/* The state of a streamed encipher or decipher, one part per pipeline stage. */
+typedef struct stream_t {
+  /* Reader: the input, the number of bytes left to read, bytes already read
+   * from it that are still to be handed on, the optional armor decoder and
+   * decoded bytes that did not fit in the last read.
+   */
+  FILE*      input_fp;
+  uint64     limit;
+  uint8*     pending;
+  uint32     pending_length;
+  decoder_t* decoder;
+  uint8      spill[64];
+  uint32     spilled;
+
+  /* Set once the input could not be read, or its armor was malformed; the
+   * stream then ends there. error is the errno of a failed read, else 0.
+   */
+  int failed;
+  int error;
+
+  /* Worker: the cipher, the optional checkpoint index and the optional
+   * shuffle window, which is undone before deciphering (inverse) or applied
+   * after enciphering.
+   */
+  zigma_t*      ziggy;
+  checkpoint_t* index;
+  zigma_cb_t*   callback;
+  uint32        window;
+  int           inverse;
+
+  /* Writer: the output, the number of leading bytes to drop and the number of
+   * bytes left to write after them.
+   */
+  codec_t* codec;
+  uint64   lead;
+  uint64   count;
+} stream_t;
+
+/* Read whatever input is available, up to size bytes, without waiting for a
+ * full buffer. This bypasses stdio, so nothing may read the stream through
+ * stdio before it: fread() afterwards is fine, as stdio then has nothing
+ * buffered, but bytes stdio buffered earlier would be skipped. get_passwd()
+ * reads <STDIN> past stdio for this reason.
+ *   @return The number of bytes read, 0 only at the end of the input.
+ */
+uint32 read_block(FILE* fp, uint8* data, uint32 size);
+
+/* Like read_block(), for callers that carry on after a failed read.
+ *   @return The number of bytes read, 0 at the end of the input, or -1 with
+ *           errno set.
+ */
+sint64 try_read_block(FILE* fp, uint8* data, uint32 size);
+
+/* Decode armored input in place. Malformed armor marks the stream failed.
+ *   @return The number of decoded bytes.
+ */
+uint32 stream_decode(stream_t* stream, uint8* data, uint32 size);
+
+/* Report why a stream failed, if it did.
+ *   @param stream The stream.
+ *   @param name The name of the input for the message, or NULL.
+ *   @return 1 if the stream failed, 0 otherwise.
+ */
+int stream_report(stream_t const* stream, char const* name);
+
+/* The pipeline stages of a stream (see pipeline.h): reading (and decoding)
+ * the input, the cipher, writing the output, and hashing in place of the
+ * cipher. arg is the stream_t.
+ */
+uint32 stream_read(void* arg, uint8* data, uint32 size);
+uint32 stream_work(void* arg, uint8* data, uint32 size);
+void   stream_write(void* arg, uint8* data, uint32 size);
+uint32 stream_hash(void* arg, uint8* data, uint32 size);
+
+/* Encipher or decipher the input block by block as it arrives. Reading, the
+ * cipher and writing run on their own threads, and memory use is a few blocks
+ * (or shuffle windows) whatever the size of the input.
+ *   @return The number of bytes read.
+ */
+uint64 stream_blocks(stream_t* stream);
+
+/* Encipher or decipher the input block by block on the calling thread, for
+ * callers that keep the other processors busy with other inputs.
+ *   @return The number of bytes read.
+ */
+uint64 stream_serial(stream_t* stream);
+
+/* Read the rest of the (decoded) input into a matrix that already holds total
+ * bytes.
+ *   @return The number of bytes in the matrix.
+ */
+uint64 stream_gather(stream_t* stream, matrix_t* matrix, uint64 total);
+
+/* Read the start of a cryptogram, where a window header may be, and set up
+ * the stream for it. The start of a segmented container is put into the
+ * container matrix instead, if there is one, and anything else is deciphered
+ * and written straight away.
+ *   @return The number of bytes read.
+ */
+uint32 stream_begin(stream_t* stream, matrix_t* container);
+
+#endif /* _ZIGMA_STREAM_H_ */
@@ -0,0 +1,470 @@
+/*
+ * ZIGMA, Copyright (C) 1999, 2005, 2023 Chase Zehl O'Byrne
+ *  <mail: zehl@live.com> http://zehlchen.com/
+ *
+ * This file is part of ZIGMA.
+ *
+ * ZIGMA is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ZIGMA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ZIGMA; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "codec.h"
+#include "pool.h"
+#include "segment.h"
+#include "stats.h"
+#include "stream.h"
+#include "tree.h"
+#include "window.h"
+#include "zigma.h"
+
+/* Work order of a directory or file task. */
+typedef struct tree_entry_t {
+  tree_t* tree;
+  char*   source;
+  char*   target;
+} tree_entry_t;
+
+static char* tree_join(char const* directory, char const* name)
+{
+  size_t length = strlen(directory);
+  char*  path   = (char*) malloc(length + strlen(name) + 2);
+
+  DEBUG_ASSERT(path != NULL);
+
+  strcpy(path, directory);
+
+  if (length == 0 || path[length - 1] != '/')
+    path[length++] = '/';
+
+  strcpy(path + length, name);
+
+  return path;
+}
+
+static tree_entry_t* tree_entry(tree_t* tree, char* source, char* target)
+{
+  tree_entry_t* entry = (tree_entry_t*) malloc(sizeof(tree_entry_t));
+
+  DEBUG_ASSERT(entry != NULL);
+
+  entry->tree   = tree;
+  entry->source = source;
+  entry->target = target;
+
+  return entry;
+}
+
+static void tree_entry_free(tree_entry_t* entry)
+{
+  free(entry->source);
+  free(entry->target);
+  free(entry);
+}
+
+/* Create a directory of the output tree, or accept one that exists. */
+static int tree_mkdir(tree_t* tree, char const* target, mode_t mode)
+{
+  struct stat st;
+
+  if (mkdir(target, mode | S_IRWXU) == 0 || (errno == EEXIST && stat(target, &st) == 0 && S_ISDIR(st.st_mode)))
+    return 1;
+
+  fprintf(stderr, "ERROR: mkdir(): unable to create directory '%s': %s\n", target, strerror(errno));
+  tree_fail(tree);
+
+  return 0;
+}
+
+static void tree_file_task(void* arg)
+{
+  tree_entry_t* entry = arg;
+
+  entry->tree->file(entry->tree, entry->source, entry->target);
+  atomic_fetch_add(&entry->tree->files, 1);
+
+  tree_entry_free(entry);
+}
+
+static void tree_directory_task(void* arg)
+{
+  tree_entry_t*  entry = arg;
+  tree_t*        tree  = entry->tree;
+  DIR*           dir   = opendir(entry->source);
+  struct dirent* item;
+
+  if (dir == NULL) {
+    fprintf(stderr, "ERROR: opendir(): unable to read directory '%s': %s\n", entry->source, strerror(errno));
+    tree_fail(tree);
+    tree_entry_free(entry);
+    return;
+  }
+
+  atomic_fetch_add(&tree->directories, 1);
+
+  while ((item = readdir(dir)) != NULL) {
+    if (strcmp(item->d_name, ".") == 0 || strcmp(item->d_name, "..") == 0)
+      continue;
+
+    char*       source = tree_join(entry->source, item->d_name);
+    char*       target = tree_join(entry->target, item->d_name);
+    struct stat st;
+
+    if (lstat(source, &st) != 0) {
+      fprintf(stderr, "ERROR: lstat(): unable to examine '%s': %s\n", source, strerror(errno));
+      tree_fail(tree);
+    }
+    else if (S_ISDIR(st.st_mode)) {
+      if (tree_mkdir(tree, target, st.st_mode & 07777)) {
+        pool_submit(tree->pool, tree_directory_task, tree_entry(tree, source, target));
+        continue;
+      }
+    }
+    else if (S_ISREG(st.st_mode)) {
+      pool_submit(tree->pool, tree_file_task, tree_entry(tree, source, target));
+      continue;
+    }
+    else {
+      fprintf(stderr, "WARNING: skipping '%s', not a regular file or directory\n", source);
+    }
+
+    free(source);
+    free(target);
+  }
+
+  closedir(dir);
+  tree_entry_free(entry);
+}
+
+void tree_walk(tree_t* tree, char const* source, char const* target)
+{
+  struct stat st;
+  char        source_real[PATH_MAX];
+  char        target_real[PATH_MAX];
+
+  DEBUG_ASSERT(tree != NULL);
+  DEBUG_ASSERT(tree->file != NULL);
+
+  atomic_init(&tree->directories, 0);
+  atomic_init(&tree->files, 0);
+  atomic_init(&tree->bytes, 0);
+  atomic_init(&tree->failures, 0);
+
+  if (stat(source, &st) != 0 || !S_ISDIR(st.st_mode)) {
+    fprintf(stderr, "ERROR: '%s' is not a directory\n", source);
+    exit(EXIT_FAILURE);
+  }
+
+  if (!tree_mkdir(tree, target, st.st_mode & 07777))
+    exit(EXIT_FAILURE);
+
+  /* The walk would go on forever through its own output. */
+  if (realpath(source, source_real) == NULL || realpath(target, target_real) == NULL) {
+    fprintf(stderr, "ERROR: realpath(): unable to resolve '%s' or '%s': %s\n", source, target, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  size_t length = strlen(source_real);
+
+  if (strncmp(source_real, target_real, length) == 0 && (target_real[length] == '\0' || target_real[length] == '/' || length == 1)) {
+    fprintf(stderr, "ERROR: the output directory '%s' lies inside the input directory '%s'\n", target, source);
+    rmdir(target);
+    exit(EXIT_FAILURE);
+  }
+
+  pool_submit(tree->pool, tree_directory_task, tree_entry(tree, safe_strdup(source), safe_strdup(target)));
+  pool_wait(tree->pool);
+}
+
+void tree_fail(tree_t* tree)
+{
+  atomic_fetch_add(&tree->failures, 1);
+}
+
+/* A file of the tree split into segments, shared by its segment tasks; the
+ * last one to finish closes the files.
+ */
+typedef struct tree_split_t {
+  tree_t*          tree;
+  FILE*            input_fp;
+  FILE*            output_fp;
+  char*            target;
+  segment_header_t header;
+  uint64           input_offset;
+  uint64           output_offset;
+  atomic_uint      left;
+  atomic_int       failed;
+} tree_split_t;
+
+typedef struct tree_segment_t {
+  tree_split_t* split;
+  uint32        index;
+} tree_segment_t;
+
+static void tree_split_finish(tree_split_t* split)
+{
+  if (fclose(split->output_fp) != 0 && !atomic_exchange(&split->failed, 1)) {
+    fprintf(stderr, "ERROR: fclose(): unable to write '%s': %s\n", split->target, strerror(errno));
+    tree_fail(split->tree);
+  }
+
+  fclose(split->input_fp);
+  free(split->target);
+  free(split);
+}
+
+static void tree_segment_task(void* arg)
+{
+  tree_segment_t* segment = arg;
+  tree_split_t*   split   = segment->split;
+  tree_job_t*     job     = split->tree->arg;
+  uint64          offset  = (uint64) segment->index * split->header.segment_size;
+  uint64          size    = split->header.length - offset;
+  zigma_t         state;
+
+  size = size < split->header.segment_size ? size : split->header.segment_size;
+
+  uint8* data = (uint8*) malloc(size);
+
+  DEBUG_ASSERT(data != NULL);
+
+  STATS_BEGIN(read_time);
+
+  if (pread(fileno(split->input_fp), data, size, split->input_offset + offset) != (ssize_t) size) {
+    if (!atomic_exchange(&split->failed, 1)) {
+      fprintf(stderr, "ERROR: pread(): unable to read segment %u of '%s'\n", segment->index, split->target);
+      tree_fail(split->tree);
+    }
+  }
+  else {
+    STATS_END(STATS_READ, read_time, size);
+    STATS_BEGIN(cipher_time);
+
+    segment_derive(&state, job->base, segment->index);
+
+    if (job->inverse)
+      zigma_decrypt(&state, data, size);
+    else
+      zigma_encrypt(&state, data, size);
+
+    memnull(&state, sizeof(zigma_t));
+
+    STATS_END(STATS_CIPHER, cipher_time, size);
+    STATS_BEGIN(write_time);
+
+    if (pwrite(fileno(split->output_fp), data, size, split->output_offset + offset) != (ssize_t) size && !atomic_exchange(&split->failed, 1)) {
+      fprintf(stderr, "ERROR: pwrite(): unable to write '%s': %s\n", split->target, strerror(errno));
+      tree_fail(split->tree);
+    }
+
+    STATS_END(STATS_WRITE, write_time, size);
+  }
+
+  memnull(data, size);
+  free(data);
+  free(segment);
+
+  if (atomic_fetch_sub(&split->left, 1) == 1)
+    tree_split_finish(split);
+}
+
+/* Hand the segments of a file out to the pool as tasks of their own, so that
+ * a large file keeps every thread busy. The segments go straight from the
+ * input file to their place in the output file.
+ */
+static void tree_split(tree_t* tree, FILE* input_fp, FILE* output_fp, char const* target, segment_header_t const* header)
+{
+  tree_job_t*   job   = tree->arg;
+  tree_split_t* split = (tree_split_t*) malloc(sizeof(tree_split_t));
+
+  DEBUG_ASSERT(split != NULL);
+
+  split->tree          = tree;
+  split->input_fp      = input_fp;
+  split->output_fp     = output_fp;
+  split->target        = safe_strdup(target);
+  split->header        = *header;
+  split->input_offset  = job->inverse ? SEGMENT_HEADER_SIZE : 0;
+  split->output_offset = job->inverse ? 0 : SEGMENT_HEADER_SIZE;
+
+  atomic_init(&split->left, header->segment_count);
+  atomic_init(&split->failed, 0);
+
+  atomic_fetch_add(&tree->bytes, header->length);
+
+  /* Size the output up front, the segments land anywhere in it. */
+  if (ftruncate(fileno(output_fp), split->output_offset + header->length) != 0) {
+    fprintf(stderr, "ERROR: ftruncate(): unable to extend '%s': %s\n", target, strerror(errno));
+    atomic_store(&split->failed, 1);
+    tree_fail(tree);
+  }
+
+  if (header->segment_count == 0 || atomic_load(&split->failed)) {
+    tree_split_finish(split);
+    return;
+  }
+
+  for (uint32 i = 0; i < header->segment_count; i++) {
+    tree_segment_t* segment = (tree_segment_t*) malloc(sizeof(tree_segment_t));
+
+    DEBUG_ASSERT(segment != NULL);
+
+    segment->split = split;
+    segment->index = i;
+
+    pool_submit(tree->pool, tree_segment_task, segment);
+  }
+}
+
+void tree_file(tree_t* tree, char const* source, char const* target)
+{
+  tree_job_t* job       = tree->arg;
+  FILE*       input_fp  = fopen(source, "r");
+  FILE*       output_fp = NULL;
+
+  if (input_fp == NULL) {
+    fprintf(stderr, "ERROR: fopen(): unable to open input file '%s': %s\n", source, strerror(errno));
+    tree_fail(tree);
+    return;
+  }
+
+  output_fp = fopen(target, "w+");
+
+  if (output_fp == NULL) {
+    fprintf(stderr, "ERROR: fopen(): unable to open output file '%s': %s\n", target, strerror(errno));
+    tree_fail(tree);
+    fclose(input_fp);
+    return;
+  }
+
+  uint8            peek[CODEC_DETECT];
+  uint32           peeked = 0;
+  int              base   = 256;
+  segment_header_t header;
+  struct stat      st;
+
+  if (fstat(fileno(input_fp), &st) != 0) {
+    fprintf(stderr, "ERROR: fstat(): unable to examine '%s': %s\n", source, strerror(errno));
+    tree_fail(tree);
+    fclose(input_fp);
+    fclose(output_fp);
+    return;
+  }
+
+  if (!job->inverse && job->segment_size != 0) {
+    uint8 data[SEGMENT_HEADER_SIZE];
+
+    segment_plan(&header, job->segment_size, st.st_size);
+    segment_write_header(&header, data);
+
+    if (pwrite(fileno(output_fp), data, SEGMENT_HEADER_SIZE, 0) != SEGMENT_HEADER_SIZE) {
+      fprintf(stderr, "ERROR: pwrite(): unable to write '%s': %s\n", target, strerror(errno));
+      tree_fail(tree);
+      fclose(input_fp);
+      fclose(output_fp);
+      return;
+    }
+
+    tree_split(tree, input_fp, output_fp, target, &header);
+    return;
+  }
+
+  if (job->inverse) {
+    sint64 count = 0;
+
+    while (peeked < sizeof(peek) && (count = try_read_block(input_fp, peek + peeked, sizeof(peek) - peeked)) > 0)
+      peeked += count;
+
+    if (count < 0) {
+      fprintf(stderr, "ERROR: read(): unable to read '%s': %s\n", source, strerror(errno));
+      tree_fail(tree);
+      fclose(input_fp);
+      fclose(output_fp);
+      return;
+    }
+
+    base = codec_detect(peek, peeked);
+
+    /* A segmented container that is all there splits like it was made. */
+    if (base == 256 && segment_read_header(&header, peek, peeked) && header.length == (uint64) st.st_size - SEGMENT_HEADER_SIZE) {
+      tree_split(tree, input_fp, output_fp, target, &header);
+      return;
+    }
+  }
+
+  zigma_t*  state = zigma_clone(NULL, job->base);
+  codec_t   codec;
+  decoder_t decoder;
+  stream_t  stream = {
+       .input_fp       = input_fp,
+       .limit          = (uint64) -1,
+       .pending        = peek,
+       .pending_length = peeked,
+       .ziggy          = state,
+       .callback       = job->inverse ? zigma_decrypt : zigma_encrypt,
+       .window         = job->inverse ? 0 : job->window,
+       .inverse        = job->inverse,
+       .codec          = &codec,
+       .count          = (uint64) -1,
+  };
+  uint64 total = 0;
+
+  codec_begin(&codec, output_fp, job->inverse ? 256 : job->output_base);
+
+  if (base != 256) {
+    decoder_begin(&decoder, base);
+    stream.decoder = &decoder;
+  }
+
+  if (job->inverse) {
+    total = stream_begin(&stream, NULL);
+  }
+  else if (job->window != 0) {
+    uint8 data[WINDOW_HEADER_SIZE];
+
+    window_write_header(job->window, data);
+    codec_write(&codec, data, WINDOW_HEADER_SIZE);
+  }
+
+  total += stream_serial(&stream);
+  atomic_fetch_add(&tree->bytes, total);
+
+  if (stream_report(&stream, source)) {
+    tree_fail(tree);
+  }
+  else if (stream.decoder != NULL && !decoder_end(stream.decoder)) {
+    fprintf(stderr, "ERROR: the armored input '%s' is malformed or truncated\n", source);
+    tree_fail(tree);
+  }
+
+  codec_end(&codec);
+
+  if (fclose(output_fp) != 0) {
+    fprintf(stderr, "ERROR: fclose(): unable to write '%s': %s\n", target, strerror(errno));
+    tree_fail(tree);
+  }
+
+  fclose(input_fp);
+  zigma_destroy(state);
+}
@@ -0,0 +1,92 @@
+/*
+ * ZIGMA, Copyright (C) 1999, 2005, 2023 Chase Zehl O'Byrne
+ *  <mail: zehl@live.com> http://zehlchen.com/
+ *
+ * This file is part of ZIGMA.
+ *
+ * ZIGMA is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ZIGMA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ZIGMA; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#pragma once
+#ifndef _ZIGMA_TREE_H_
+#define _ZIGMA_TREE_H_
+
+#include <stdatomic.h>
+
+#include "pool.h"
+#include "zigma.h"
+
+typedef struct tree_t tree_t;
+
+/* Processes one regular file of the tree, on a thread of the pool.
+ *   @param tree The walk the file belongs to.
+ *   @param source The path of the file in the input tree.
+ *   @param target The path of the file to create in the output tree.
+ *   @note Failures are reported with tree_fail(); the walk goes on.
+ */
+typedef void(tree_file_t)(tree_t* tree, char const* source, char const* target);
+
+/* A walk of a directory tree. Every directory is read by a task of its own,
+ * which recreates it in the output tree and submits a task for each entry,
+ * so that directories and files of any shape spread over the whole pool.
+ */
+struct tree_t {
+  /* The pool the tasks run on, the file handler and its argument. */
+  pool_t*      pool;
+  tree_file_t* file;
+  void*        arg;
+
+  /* Directories and files seen, bytes read and failures so far. */
+  atomic_ullong directories;
+  atomic_ullong files;
+  atomic_ullong bytes;
+  atomic_ullong failures;
+};
+
+/* Counts a failure of the walk; the reason has been printed already.
+ *   @param tree The walk.
+ */
+void tree_fail(tree_t* tree);
+
+/* What the tasks of a tree need to encipher or decipher a file: the keyed
+ * state, which every file starts from, and the output format.
+ */
+typedef struct tree_job_t {
+  zigma_t const* base;
+  int            inverse;
+  int            output_base;
+  uint32         segment_size;
+  uint32         window;
+} tree_job_t;
+
+/* Encipher or decipher one file of the tree, the way e and d would with the
+ * file as if= and of=; a tree_file_t with a tree_job_t as the walk's arg.
+ * With segment_size (or a segmented input when deciphering) the segments of
+ * the file are handed out to the pool as tasks of their own.
+ */
+void tree_file(tree_t* tree, char const* source, char const* target);
+
+/* Mirrors the directory tree under source to target, calling tree->file for
+ * every regular file, and returns once every file has been processed.
+ * Symbolic links and special files are skipped with a warning.
+ *   @param tree The walk, with pool, file and arg set.
+ *   @param source The input directory.
+ *   @param target The output directory; it is created if need be and may
+ *                 not lie inside the input directory.
+ */
+void tree_walk(tree_t* tree, char const* source, char const* target);
+
+#endif /* _ZIGMA_TREE_H_ */
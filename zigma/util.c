@@ -0,0 +1,116 @@
+/*
+ * ZIGMA, Copyright (C) 1999, 2005, 2023 Chase Zehl O'Byrne
+ *  <mail: zehl@live.com> http://zehlchen.com/
+ *
+ * This file is part of ZIGMA.
+ *
+ * ZIGMA is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ZIGMA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ZIGMA; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "zigma.h"
+
+/* Convert using multiplicative suffixes */
+uint64 str2bytes(char const* str)
+{
+  int len = strlen(str);
+
+  if (len == 0)
+    return 0;
+
+  char suffix = str[len - 1];
+
+  uint64 value = strtoull(str, NULL, 0);
+
+  switch (suffix) {
+    case 'C':
+    case 'c':
+      return value;
+    case 'K':
+    case 'k':
+      return value << 10;
+    case 'M':
+    case 'm':
+      return value << 20;
+    case 'G':
+    case 'g':
+      return value << 30;
+    default:
+      return value;
+  }
+}
+
+char* safe_strdup(char const* str)
+{
+  DEBUG_ASSERT(str != NULL);
+
+  size_t len  = strlen(str) + 1;
+  char*  copy = malloc(len);
+
+  DEBUG_ASSERT(copy != NULL);
+
+  strncpy(copy, str, len); /*  NOLINT */
+
+  copy[len - 1] = '\0';
+
+  return copy;
+}
+
+void memnull(void* ptr, uint64 size)
+{
+  if (ptr == NULL || size == 0)
+    return;
+
+  memset(ptr, 0, size);
+
+  /* The memory is usually about to be freed; keep the stores anyway. */
+  __asm__ __volatile__("" : : "r"(ptr) : "memory");
+}
+
+void pack_uint32(uint8* data, uint32 value)
+{
+  for (int i = 0; i < 4; i++)
+    data[i] = (value >> (8 * i)) & 0xFF;
+}
+
+void pack_uint64(uint8* data, uint64 value)
+{
+  for (int i = 0; i < 8; i++)
+    data[i] = (value >> (8 * i)) & 0xFF;
+}
+
+uint32 unpack_uint32(uint8 const* data)
+{
+  uint32 value = 0;
+
+  for (int i = 3; i >= 0; i--)
+    value = (value << 8) | data[i];
+
+  return value;
+}
+
+uint64 unpack_uint64(uint8 const* data)
+{
+  uint64 value = 0;
+
+  for (int i = 7; i >= 0; i--)
+    value = (value << 8) | data[i];
+
+  return value;
+}
@@ -0,0 +1,93 @@
+/*
+ * ZIGMA, Copyright (C) 1999, 2005, 2023 Chase Zehl O'Byrne
+ *  <mail: zehl@live.com> http://zehlchen.com/
+ *
+ * This file is part of ZIGMA.
+ *
+ * ZIGMA is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ZIGMA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ZIGMA; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "matrix.h"
+#include "window.h"
+#include "zigma.h"
+
+uint32 window_plan(uint32 request)
+{
+  DEBUG_ASSERT(request != 0);
+
+  uint32 magnitude = matrix_smallest_magnitude(request < WINDOW_MAX ? request : WINDOW_MAX);
+
+  return magnitude * magnitude;
+}
+
+void window_write_header(uint32 window, uint8* data)
+{
+  memcpy(data, WINDOW_MAGIC, 8);
+  pack_uint32(data + 8, window);
+}
+
+int window_read_header(uint32* window, uint8 const* data, uint64 length)
+{
+  if (length < WINDOW_HEADER_SIZE || memcmp(data, WINDOW_MAGIC, 8) != 0)
+    return 0;
+
+  *window = unpack_uint32(data + 8);
+
+  /* Only window_plan() sizes are valid. */
+  if (*window == 0 || *window > WINDOW_MAX || window_plan(*window) != *window)
+    return 0;
+
+  return 1;
+}
+
+/* Wrap each window of the buffer in a matrix and reshuffle it. A full window
+ * is a full square; the last one may be a partial square, in which case it
+ * borrows the room after it in the buffer, if any, for the fast path.
+ */
+static void window_run(uint8* data, uint64 length, uint64 capacity, uint32 window, void (*shuffle)(matrix_t*))
+{
+  DEBUG_ASSERT(capacity >= length);
+  DEBUG_ASSERT(window != 0);
+
+  for (uint64 offset = 0; offset < length; offset += window) {
+    matrix_t tile;
+    uint64   left = length - offset;
+
+    tile.length    = left < window ? left : window;
+    tile.capacity  = capacity - offset;
+    tile.magnitude = matrix_smallest_magnitude(tile.length);
+    tile.data      = data + offset;
+
+    shuffle(&tile);
+
+    if (left <= window)
+      break;
+  }
+}
+
+void window_shuffle(uint8* data, uint64 length, uint64 capacity, uint32 window)
+{
+  window_run(data, length, capacity, window, matrix_shuffle);
+}
+
+void window_unshuffle(uint8* data, uint64 length, uint64 capacity, uint32 window)
+{
+  window_run(data, length, capacity, window, matrix_unshuffle);
+}
@@ -0,0 +1,76 @@
+/*
+ * ZIGMA, Copyright (C) 1999, 2005, 2023 Chase Zehl O'Byrne
+ *  <mail: zehl@live.com> http://zehlchen.com/
+ *
+ * This file is part of ZIGMA.
+ *
+ * ZIGMA is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ZIGMA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ZIGMA; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#pragma once
+#ifndef _ZIGMA_WINDOW_H_
+#define _ZIGMA_WINDOW_H_
+
+#include "zigma.h"
+
+/* A windowed cryptogram starts with this magic ... */
+#define WINDOW_MAGIC "ZIGMAWIN"
+
+/* ... followed by the window size (32 bits, little-endian). */
+#define WINDOW_HEADER_SIZE 12
+
+/* Largest window, so that a few of them fit in memory at once. */
+#define WINDOW_MAX (64 * 1024 * 1024)
+
+/* Rounds a requested window size up to the next square, so that every full
+ * window is a full matrix, and caps it at WINDOW_MAX.
+ *   @param request The requested window size in bytes (non-zero).
+ *   @return The window size in bytes.
+ */
+uint32 window_plan(uint32 request);
+
+/* Serializes a header into WINDOW_HEADER_SIZE bytes.
+ *   @param window The window size in bytes.
+ *   @param data The output buffer.
+ */
+void window_write_header(uint32 window, uint8* data);
+
+/* Parses a header.
+ *   @param window The window size to populate.
+ *   @param data The input buffer.
+ *   @param length The number of bytes available in data.
+ *   @return 1 if data starts with a well-formed header, 0 otherwise.
+ */
+int window_read_header(uint32* window, uint8 const* data, uint64 length);
+
+/* Reshuffles data window by window with matrix_shuffle(); the last window may
+ * be short.
+ *   @param data The data to reshuffle in place.
+ *   @param length The length of the data in bytes.
+ *   @param capacity The size of the buffer holding the data, at least length.
+ *   @param window The window size in bytes, as given by window_plan().
+ */
+void window_shuffle(uint8* data, uint64 length, uint64 capacity, uint32 window);
+
+/* Reverses window_shuffle().
+ *   @param data The data to restore in place.
+ *   @param length The length of the data in bytes.
+ *   @param capacity The size of the buffer holding the data, at least length.
+ *   @param window The window size in bytes.
+ */
+void window_unshuffle(uint8* data, uint64 length, uint64 capacity, uint32 window);
+
+#endif /* _ZIGMA_WINDOW_H_ */
@@ -24,12 +24,13 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "secure.h"
 #include "zigma.h"
 
 zigma_t* zigma_init(zigma_t* handle, uint8 const* key, uint32 length)
 {
   if (handle == NULL)
-    handle = (zigma_t*) malloc(sizeof(zigma_t));
+    handle = (zigma_t*) secure_alloc(sizeof(zigma_t));
 
   if (key == NULL) {
     zigma_init_hash(handle);
@@ -80,6 +81,69 @@ zigma_t* zigma_init_hash(zigma_t* handle)
   return handle;
 }
 
+zigma_t* zigma_destroy(zigma_t* handle)
+{
+  secure_free(handle, sizeof(zigma_t));
+
+  return NULL;
+}
+
+zigma_t* zigma_clone(zigma_t* handle, zigma_t const* source)
+{
+  DEBUG_ASSERT(source != NULL);
+
+  if (handle == NULL)
+    handle = (zigma_t*) secure_alloc(sizeof(zigma_t));
+
+  DEBUG_ASSERT(handle != NULL);
+
+  memcpy(handle, source, sizeof(zigma_t));
+
+  return handle;
+}
+
+void zigma_export(zigma_t const* handle, uint8* blob)
+{
+  DEBUG_ASSERT(handle != NULL);
+  DEBUG_ASSERT(blob != NULL);
+
+  blob[0] = handle->index_A;
+  blob[1] = handle->index_B;
+  blob[2] = handle->index_C;
+  blob[3] = handle->byte_X;
+  blob[4] = handle->byte_Y;
+
+  memcpy(blob + 5, handle->vektor, 256);
+}
+
+zigma_t* zigma_import(zigma_t* handle, uint8 const* blob)
+{
+  uint8 seen[256] = {0};
+
+  DEBUG_ASSERT(blob != NULL);
+
+  /* The permutation vector must be a permutation. */
+  for (int i = 0; i < 256; i++) {
+    if (seen[blob[5 + i]]++)
+      return NULL;
+  }
+
+  if (handle == NULL)
+    handle = (zigma_t*) secure_alloc(sizeof(zigma_t));
+
+  DEBUG_ASSERT(handle != NULL);
+
+  handle->index_A = blob[0];
+  handle->index_B = blob[1];
+  handle->index_C = blob[2];
+  handle->byte_X  = blob[3];
+  handle->byte_Y  = blob[4];
+
+  memcpy(handle->vektor, blob + 5, 256);
+
+  return handle;
+}
+
 void zigma_hash_sign(zigma_t* handle, uint8* data, uint32 length)
 {
   /* Advance the permutation vector. */
@@ -140,24 +204,294 @@ uint8 zigma_decrypt_byte(zigma_t* handle, uint32 byte)
   return handle->byte_X;
 }
 
-void zigma_encrypt(zigma_t* handle, uint8* data, uint32 size)
+void zigma_encrypt_reference(zigma_t* handle, uint8* data, uint64 size)
 {
   DEBUG_ASSERT(handle != NULL);
   DEBUG_ASSERT(data != NULL);
 
-  for (int i = 0; i < size; i++)
+  for (uint64 i = 0; i < size; i++)
     data[i] = zigma_encrypt_byte(handle, data[i]);
 }
 
-void zigma_decrypt(zigma_t* handle, uint8* data, uint32 size)
+void zigma_decrypt_reference(zigma_t* handle, uint8* data, uint64 size)
 {
   DEBUG_ASSERT(handle != NULL);
   DEBUG_ASSERT(data != NULL);
 
-  for (int i = 0; i < size; i++)
+  for (uint64 i = 0; i < size; i++)
     data[i] = zigma_decrypt_byte(handle, data[i]);
 }
 
+/* One round of the cipher, shared by every bulk kernel.
+ * V(i) names vektor[i & 0xFF] and A, B, C, X and Y are the indexes and the
+ * feedback bytes, all plain lvalues so the caller decides where they live.
+ * When encrypting, X takes the input and Y the output; decrypting swaps them.
+ */
+#define ZIGMA_ROUND(V, A, B, C, X, Y, input, output, decrypt)   \
+  do {                                                          \
+    uint8 _in = (input);                                        \
+    uint8 _out;                                                 \
+    uint8 _swap;                                                \
+                                                                \
+    B += V(A++);                                                \
+                                                                \
+    _swap = V(Y);                                               \
+    V(Y)  = V(B);                                               \
+    V(B)  = V(X);                                               \
+    V(X)  = V(A);                                               \
+    V(A)  = _swap;                                              \
+                                                                \
+    C += V(_swap);                                              \
+                                                                \
+    _out     = _in ^ V(V(B) + V(A)) ^ V(V(V(X) + V(Y) + V(C))); \
+    (output) = _out;                                            \
+    X        = (decrypt) ? _out : _in;                          \
+    Y        = (decrypt) ? _in : _out;                          \
+  } while (0)
+
+/* Bulk kernel: the state is loaded into locals once, the loop is unrolled
+ * four times and the state is written back when the buffer is done. OUT(i)
+ * names where the result for data[i] goes; the remaining arguments are the
+ * parameters after the handle, which must include data and size.
+ */
+#define ZIGMA_KERNEL(name, decrypt, OUT, ...)                                                            \
+  void name(zigma_t* handle, __VA_ARGS__)                                                                \
+  {                                                                                                      \
+    DEBUG_ASSERT(handle != NULL);                                                                        \
+    DEBUG_ASSERT(size == 0 || data != NULL);                                                             \
+                                                                                                         \
+    uint8* vektor  = handle->vektor;                                                                     \
+    uint8  index_A = handle->index_A;                                                                    \
+    uint8  index_B = handle->index_B;                                                                    \
+    uint8  index_C = handle->index_C;                                                                    \
+    uint8  byte_X  = handle->byte_X;                                                                     \
+    uint8  byte_Y  = handle->byte_Y;                                                                     \
+    uint8  sink    = 0;                                                                                  \
+    uint64 i       = 0;                                                                                  \
+                                                                                                         \
+    for (; i + 4 <= size; i += 4) {                                                                      \
+      ZIGMA_ROUND(ZIGMA_V, index_A, index_B, index_C, byte_X, byte_Y, data[i + 0], OUT(i + 0), decrypt); \
+      ZIGMA_ROUND(ZIGMA_V, index_A, index_B, index_C, byte_X, byte_Y, data[i + 1], OUT(i + 1), decrypt); \
+      ZIGMA_ROUND(ZIGMA_V, index_A, index_B, index_C, byte_X, byte_Y, data[i + 2], OUT(i + 2), decrypt); \
+      ZIGMA_ROUND(ZIGMA_V, index_A, index_B, index_C, byte_X, byte_Y, data[i + 3], OUT(i + 3), decrypt); \
+    }                                                                                                    \
+                                                                                                         \
+    for (; i < size; i++)                                                                                \
+      ZIGMA_ROUND(ZIGMA_V, index_A, index_B, index_C, byte_X, byte_Y, data[i], OUT(i), decrypt);         \
+                                                                                                         \
+    handle->index_A = index_A;                                                                           \
+    handle->index_B = index_B;                                                                           \
+    handle->index_C = index_C;                                                                           \
+    handle->byte_X  = byte_X;                                                                            \
+    handle->byte_Y  = byte_Y;                                                                            \
+    (void) sink;                                                                                         \
+  }
+
+#define ZIGMA_V(i)       vektor[(uint8) (i)]
+#define ZIGMA_INPLACE(i) data[i]
+#define ZIGMA_COPY(i)    output[i]
+#define ZIGMA_DISCARD(i) sink
+
+ZIGMA_KERNEL(zigma_encrypt, 0, ZIGMA_INPLACE, uint8* data, uint64 size)
+ZIGMA_KERNEL(zigma_decrypt, 1, ZIGMA_INPLACE, uint8* data, uint64 size)
+ZIGMA_KERNEL(zigma_encrypt_copy, 0, ZIGMA_COPY, uint8 const* data, uint8* output, uint64 size)
+ZIGMA_KERNEL(zigma_decrypt_copy, 1, ZIGMA_COPY, uint8 const* data, uint8* output, uint64 size)
+ZIGMA_KERNEL(zigma_hash_update, 0, ZIGMA_DISCARD, uint8 const* data, uint64 size)
+
+#undef ZIGMA_V
+#undef ZIGMA_INPLACE
+#undef ZIGMA_COPY
+#undef ZIGMA_DISCARD
+
+/* Interleaved state for the lockstep path. Lane L of every field belongs to
+ * the L-th message, so vektor[i][] of all lanes shares a single cache line.
+ */
+typedef struct zigma_lanes_t {
+  uint8 index_A[ZIGMA_MULTI_MAX];
+  uint8 index_B[ZIGMA_MULTI_MAX];
+  uint8 index_C[ZIGMA_MULTI_MAX];
+  uint8 byte_X[ZIGMA_MULTI_MAX];
+  uint8 byte_Y[ZIGMA_MULTI_MAX];
+  uint8 vektor[256][ZIGMA_MULTI_MAX];
+} zigma_lanes_t;
+
+/* Move a zigma object into lane l. */
+static void zigma_lane_load(zigma_lanes_t* lanes, uint32 l, zigma_t const* handle)
+{
+  lanes->index_A[l] = handle->index_A;
+  lanes->index_B[l] = handle->index_B;
+  lanes->index_C[l] = handle->index_C;
+  lanes->byte_X[l]  = handle->byte_X;
+  lanes->byte_Y[l]  = handle->byte_Y;
+
+  for (int i = 0; i < 256; i++)
+    lanes->vektor[i][l] = handle->vektor[i];
+}
+
+/* Move lane l back out into a zigma object. */
+static void zigma_lane_store(zigma_lanes_t const* lanes, uint32 l, zigma_t* handle)
+{
+  handle->index_A = lanes->index_A[l];
+  handle->index_B = lanes->index_B[l];
+  handle->index_C = lanes->index_C[l];
+  handle->byte_X  = lanes->byte_X[l];
+  handle->byte_Y  = lanes->byte_Y[l];
+
+  for (int i = 0; i < 256; i++)
+    handle->vektor[i] = lanes->vektor[i][l];
+}
+
+/* Move lane `from` over lane `to`. */
+static void zigma_lane_move(zigma_lanes_t* lanes, uint32 from, uint32 to)
+{
+  lanes->index_A[to] = lanes->index_A[from];
+  lanes->index_B[to] = lanes->index_B[from];
+  lanes->index_C[to] = lanes->index_C[from];
+  lanes->byte_X[to]  = lanes->byte_X[from];
+  lanes->byte_Y[to]  = lanes->byte_Y[from];
+
+  for (int i = 0; i < 256; i++)
+    lanes->vektor[i][to] = lanes->vektor[i][from];
+}
+
+/* Advance the first `count` lanes over `size` bytes of their messages. This is
+ * the same ZIGMA_ROUND as the bulk kernels; it is inlined
+ * with a constant lane count so the inner loop unrolls completely and the
+ * independent lanes can be scheduled side by side.
+ */
+static inline void zigma_lanes_run(zigma_lanes_t* s, uint8** data, uint32 size, uint32 count, int decrypt)
+{
+  uint8  index_A[ZIGMA_MULTI_MAX];
+  uint8  index_B[ZIGMA_MULTI_MAX];
+  uint8  index_C[ZIGMA_MULTI_MAX];
+  uint8  byte_X[ZIGMA_MULTI_MAX];
+  uint8  byte_Y[ZIGMA_MULTI_MAX];
+  uint8* cursor[ZIGMA_MULTI_MAX];
+
+  /* Work on local copies: they cannot alias vektor[] and stay in registers. */
+  memcpy(cursor, data, count * sizeof(uint8*));
+  memcpy(index_A, s->index_A, count);
+  memcpy(index_B, s->index_B, count);
+  memcpy(index_C, s->index_C, count);
+  memcpy(byte_X, s->byte_X, count);
+  memcpy(byte_Y, s->byte_Y, count);
+
+#define V(i) s->vektor[(uint8) (i)][l]
+  for (uint32 i = 0; i < size; i++) {
+    for (uint32 l = 0; l < count; l++)
+      ZIGMA_ROUND(V, index_A[l], index_B[l], index_C[l], byte_X[l], byte_Y[l], cursor[l][i], cursor[l][i], decrypt);
+  }
+#undef V
+
+  memcpy(s->index_A, index_A, count);
+  memcpy(s->index_B, index_B, count);
+  memcpy(s->index_C, index_C, count);
+  memcpy(s->byte_X, byte_X, count);
+  memcpy(s->byte_Y, byte_Y, count);
+}
+
+static void zigma_multi(zigma_t** handles, uint8** data, uint32 const* sizes, uint32 count, int decrypt)
+{
+  zigma_lanes_t lanes;
+  uint32        message[ZIGMA_MULTI_MAX];
+  uint32        offset[ZIGMA_MULTI_MAX];
+  uint8*        cursor[ZIGMA_MULTI_MAX];
+  uint32        active = 0;
+  uint32        next   = 0;
+
+  DEBUG_ASSERT(handles != NULL);
+  DEBUG_ASSERT(data != NULL);
+  DEBUG_ASSERT(sizes != NULL);
+
+  while (1) {
+    /* A lane whose message is done takes on the next one, so that a short
+     * message does not leave the others to finish on their own.
+     */
+    for (; active < ZIGMA_MULTI_MAX && next < count; next++) {
+      if (sizes[next] == 0)
+        continue;
+
+      message[active] = next;
+      offset[active]  = 0;
+
+      zigma_lane_load(&lanes, active, handles[next]);
+      active++;
+    }
+
+    if (active == 0)
+      break;
+
+    /* The last message left is faster on its own. */
+    if (active == 1) {
+      zigma_t* handle = handles[message[0]];
+
+      zigma_lane_store(&lanes, 0, handle);
+
+      if (decrypt)
+        zigma_decrypt(handle, data[message[0]] + offset[0], sizes[message[0]] - offset[0]);
+      else
+        zigma_encrypt(handle, data[message[0]] + offset[0], sizes[message[0]] - offset[0]);
+
+      break;
+    }
+
+    /* Every lane runs in lockstep until the first of them is done. */
+    uint32 steps = sizes[message[0]] - offset[0];
+
+    for (uint32 l = 0; l < active; l++) {
+      steps     = sizes[message[l]] - offset[l] < steps ? sizes[message[l]] - offset[l] : steps;
+      cursor[l] = data[message[l]] + offset[l];
+    }
+
+    switch (active) {
+      case 16:
+        zigma_lanes_run(&lanes, cursor, steps, 16, decrypt);
+        break;
+      case 8:
+        zigma_lanes_run(&lanes, cursor, steps, 8, decrypt);
+        break;
+      case 4:
+        zigma_lanes_run(&lanes, cursor, steps, 4, decrypt);
+        break;
+      default:
+        zigma_lanes_run(&lanes, cursor, steps, active, decrypt);
+        break;
+    }
+
+    for (uint32 l = 0; l < active; l++)
+      offset[l] += steps;
+
+    /* Retire the lanes that are done, moving the last lane into each gap. */
+    for (uint32 l = 0; l < active;) {
+      if (offset[l] < sizes[message[l]]) {
+        l++;
+        continue;
+      }
+
+      zigma_lane_store(&lanes, l, handles[message[l]]);
+
+      if (l != --active) {
+        zigma_lane_move(&lanes, active, l);
+
+        message[l] = message[active];
+        offset[l]  = offset[active];
+      }
+    }
+  }
+
+  memnull(&lanes, sizeof(zigma_lanes_t));
+}
+
+void zigma_encrypt_multi(zigma_t** handles, uint8** data, uint32 const* sizes, uint32 count)
+{
+  zigma_multi(handles, data, sizes, count, 0);
+}
+
+void zigma_decrypt_multi(zigma_t** handles, uint8** data, uint32 const* sizes, uint32 count)
+{
+  zigma_multi(handles, data, sizes, count, 1);
+}
+
 uint8 zigma_keyrand(zigma_t* handle, uint32 limit, uint8 const* key, uint32 length, uint8* rsum, uint32* keypos)
 {
   uint32 u;
@@ -177,8 +511,9 @@ uint8 zigma_keyrand(zigma_t* handle, uint32 limit, uint8 const* key, uint32 leng
 
     u = mask & *rsum;
 
+    /* The last swap (limit 0) can only pick 0; avoid dividing by it. */
     if (++retry_limiter > 11)
-      u %= limit;
+      u = limit ? u % limit : 0;
 
   } while (u > limit);
 
@@ -46,6 +46,15 @@ typedef long long sint64;
 #define ZIGMA_CHECKSUM_SIZE 32 /* 256 bits */
 #endif
 
+/* Marks the functions libzigma exports. The library is built with hidden
+ * visibility, so its helpers (str2bytes() and the like) stay internal.
+ */
+#if defined(__GNUC__)
+#define ZIGMA_API __attribute__((visibility("default")))
+#else
+#define ZIGMA_API
+#endif
+
 /*
  * Debug code ... respect no-debug requests.
  */
@@ -59,13 +68,6 @@ typedef long long sint64;
 #define DEBUG_ASSERT(x)
 #endif
 
-/* Debug Verbosity */
-typedef enum { DEBUG_NONE = 0, DEBUG_LOW, DEBUG_MEDIUM, DEBUG_HIGH } debug_level_t;
-
-extern debug_level_t DEBUG_LEVEL;
-
-void debug_printf(debug_level_t level, char const* format, ...);
-
 #define DEBUG_PRINT_ARRAY(var, size)                    \
   {                                                     \
     fprintf(stderr, "(" #var ") = %d <", size);         \
@@ -80,13 +82,19 @@ void debug_printf(debug_level_t level, char const* format, ...);
  */
 
 /* Add a multiplicative value to a number K, M, G and so on*/
-uint32 str2bytes(char const* str);
+uint64 str2bytes(char const* str);
 
 /* Duplicate a string safely */
 char* safe_strdup(char const* str);
 
-/* Get rid of something for good */
-void memnull(void* ptr, uint32 size);
+/* Get rid of something for good, with wide stores the compiler cannot drop */
+void memnull(void* ptr, uint64 size);
+
+/* Store and load little-endian integers for the container formats */
+void   pack_uint32(uint8* data, uint32 value);
+void   pack_uint64(uint8* data, uint64 value);
+uint32 unpack_uint32(uint8 const* data);
+uint64 unpack_uint64(uint8 const* data);
 
 /*
  * The Zigma Cipher
@@ -114,28 +122,69 @@ typedef struct zigma_t {
 } zigma_t;
 
 /* Initializes and allocates a zigma object.
- * If the zigma object is NULL, it will be allocated. If the key is NULL, the
- * zigma object will be initialized with a hash function. If the key is not
- * NULL, the zigma object will be initialized with the key.
+ * If the zigma object is NULL, it will be allocated in locked memory (see
+ * secure_alloc()) and must be released with zigma_destroy(). If the key is
+ * NULL, the zigma object will be initialized with a hash function. If the key
+ * is not NULL, the zigma object will be initialized with the key.
  *   @param handle The zigma object to initialize.
  *   @param key The key to initialize the zigma object with or NULL for hash.
  *   @param length The length of the key in bytes.
  *   @return The initialized zigma object.
  */
-zigma_t* zigma_init(zigma_t* handle, uint8 const* key, uint32 length);
+ZIGMA_API zigma_t* zigma_init(zigma_t* handle, uint8 const* key, uint32 length);
+
+/* Destroys a zigma object allocated by zigma_init(), zigma_clone() or
+ * zigma_import(), which keep it in locked memory.
+ *   @param handle The zigma object to securely destroy, or NULL.
+ *   @return NULL.
+ */
+ZIGMA_API zigma_t* zigma_destroy(zigma_t* handle);
 
 /* Initializes a non-NULL zigma object for use as a hash.
  *   @param handle The zigma object to initialize.
  *   @return The initialized zigma object.
  */
-zigma_t* zigma_init_hash(zigma_t* handle);
+ZIGMA_API zigma_t* zigma_init_hash(zigma_t* handle);
+
+/* Size in bytes of an exported zigma object. */
+#define ZIGMA_STATE_SIZE (5 + 256)
+
+/* Copies a zigma object, e.g. to reuse an expanded key without running the
+ * key schedule again.
+ *   @param handle The zigma object to populate, or NULL to allocate one.
+ *   @param source The zigma object to copy.
+ *   @return The copy.
+ */
+ZIGMA_API zigma_t* zigma_clone(zigma_t* handle, zigma_t const* source);
+
+/* Exports a zigma object as an opaque blob of ZIGMA_STATE_SIZE bytes.
+ *   @param handle The zigma object to export.
+ *   @param blob The output buffer.
+ *   @note The blob is as sensitive as the key itself.
+ */
+ZIGMA_API void zigma_export(zigma_t const* handle, uint8* blob);
+
+/* Imports a zigma object from a blob made by zigma_export().
+ *   @param handle The zigma object to populate, or NULL to allocate one.
+ *   @param blob The ZIGMA_STATE_SIZE byte blob.
+ *   @return The imported zigma object, or NULL if the blob is malformed.
+ */
+ZIGMA_API zigma_t* zigma_import(zigma_t* handle, uint8 const* blob);
 
 /* Terminate the state for the purpose of generating a checksum.
  *   @param handle The zigma object to terminate.
  *   @param data The checksum value to be populated.
  *   @param length The length of the hash checksum in bytes.
  */
-void zigma_hash_sign(zigma_t* handle, uint8* data, uint32 length);
+ZIGMA_API void zigma_hash_sign(zigma_t* handle, uint8* data, uint32 length);
+
+/* Absorb data into a hash state without modifying it.
+ * Equivalent to zigma_encrypt() on a copy of the data.
+ *   @param handle The zigma object to update.
+ *   @param data The data to absorb.
+ *   @param size The size of the data in bytes.
+ */
+ZIGMA_API void zigma_hash_update(zigma_t* handle, uint8 const* data, uint64 size);
 
 /* Encrypt a single byte.
  *   @param handle The zigma object to encrypt with.
@@ -143,7 +192,7 @@ void zigma_hash_sign(zigma_t* handle, uint8* data, uint32 length);
  *   @return The encrypted byte.
  *   @note The zigma object must have been initialized with a key.
  */
-unsigned char zigma_encrypt_byte(zigma_t* handle, uint32 z);
+ZIGMA_API unsigned char zigma_encrypt_byte(zigma_t* handle, uint32 z);
 
 /* Decrypt a single byte.
  *   @param handle The zigma object to decrypt with.
@@ -151,15 +200,17 @@ unsigned char zigma_encrypt_byte(zigma_t* handle, uint32 z);
  *   @return The decrypted byte.
  *   @note The zigma object must have been initialized with a key.
  */
-unsigned char zigma_decrypt_byte(zigma_t* handle, uint32 z);
+ZIGMA_API unsigned char zigma_decrypt_byte(zigma_t* handle, uint32 z);
 
 /* Encrypt a string of data.
+ * The state is kept in registers for the whole buffer and only written back
+ * to the zigma object at the end.
  *   @param handle The zigma object to encrypt with.
  *   @param data The data to encrypt.
  *   @param size The size of the data in bytes.
  *   @note The zigma object must have been initialized with a key.
  */
-void zigma_encrypt(zigma_t* handle, uint8* data, uint32 size);
+ZIGMA_API void zigma_encrypt(zigma_t* handle, uint8* data, uint64 size);
 
 /* Decrypt a string of data.
  *   @param handle The zigma object to decrypt with.
@@ -167,7 +218,67 @@ void zigma_encrypt(zigma_t* handle, uint8* data, uint32 size);
  *   @param size The size of the data in bytes.
  *   @note The zigma object must have been initialized with a key.
  */
-void zigma_decrypt(zigma_t* handle, uint8* data, uint32 size);
+ZIGMA_API void zigma_decrypt(zigma_t* handle, uint8* data, uint64 size);
+
+/* Encrypt a string of data into a separate buffer.
+ * Same as zigma_encrypt() on a copy, without making the copy first.
+ *   @param handle The zigma object to encrypt with.
+ *   @param data The data to encrypt.
+ *   @param output The buffer receiving the result, which may be data itself.
+ *   @param size The size of the data in bytes.
+ */
+ZIGMA_API void zigma_encrypt_copy(zigma_t* handle, uint8 const* data, uint8* output, uint64 size);
+
+/* Decrypt a string of data into a separate buffer.
+ *   @param handle The zigma object to decrypt with.
+ *   @param data The data to decrypt.
+ *   @param output The buffer receiving the result, which may be data itself.
+ *   @param size The size of the data in bytes.
+ */
+ZIGMA_API void zigma_decrypt_copy(zigma_t* handle, uint8 const* data, uint8* output, uint64 size);
+
+/* Reference versions of zigma_encrypt() and zigma_decrypt(), one call of
+ * zigma_encrypt_byte()/zigma_decrypt_byte() per byte. They are kept for
+ * cross-checking the bulk kernels and must produce identical results.
+ *   @param handle The zigma object to encrypt or decrypt with.
+ *   @param data The data to encrypt or decrypt.
+ *   @param size The size of the data in bytes.
+ */
+ZIGMA_API void zigma_encrypt_reference(zigma_t* handle, uint8* data, uint64 size);
+ZIGMA_API void zigma_decrypt_reference(zigma_t* handle, uint8* data, uint64 size);
+
+/* Generalized callback for encrypt/decrypt */
+typedef void(zigma_cb_t)(zigma_t*, uint8*, uint64);
+
+/* Generalized callback for out-of-place encrypt/decrypt */
+typedef void(zigma_copy_t)(zigma_t*, uint8 const*, uint8*, uint64);
+
+/* Maximum number of independent zigma objects advanced in lockstep. */
+#define ZIGMA_MULTI_MAX 16
+
+/* Encrypt several independent messages at once.
+ * The zigma objects are copied into an interleaved layout and advanced in
+ * lockstep (up to ZIGMA_MULTI_MAX at a time) so that the dependent vektor[]
+ * loads of one message overlap with those of the others. A lane whose message
+ * is done takes on the next message, so messages of mixed lengths stay in
+ * lockstep too. The result is byte identical to calling zigma_encrypt() on
+ * each message in turn.
+ *   @param handles The zigma objects to encrypt with, one per message.
+ *   @param data The messages to encrypt in place.
+ *   @param sizes The size of each message in bytes.
+ *   @param count The number of messages.
+ *   @note Every zigma object must be distinct.
+ */
+ZIGMA_API void zigma_encrypt_multi(zigma_t** handles, uint8** data, uint32 const* sizes, uint32 count);
+
+/* Decrypt several independent messages at once.
+ *   @param handles The zigma objects to decrypt with, one per message.
+ *   @param data The messages to decrypt in place.
+ *   @param sizes The size of each message in bytes.
+ *   @param count The number of messages.
+ *   @note Every zigma object must be distinct.
+ */
+ZIGMA_API void zigma_decrypt_multi(zigma_t** handles, uint8** data, uint32 const* sizes, uint32 count);
 
 /* Generate a random number from a key.
  *   @param handle The zigma object to generate with.
@@ -178,12 +289,12 @@ void zigma_decrypt(zigma_t* handle, uint8* data, uint32 size);
  *   @param keypos The key position to generate with.
  *   @return The generated random number.
  */
-uint8 zigma_keyrand(zigma_t* handle, uint32 limit, uint8 const* key, uint32 length, uint8* rsum, uint32* keypos);
+ZIGMA_API uint8 zigma_keyrand(zigma_t* handle, uint32 limit, uint8 const* key, uint32 length, uint8* rsum, uint32* keypos);
 
 /* Print the state of a zigma object.
  *   @param handle The zigma object to print.
  *   @note This function is for debugging purposes only.
  */
-void zigma_print(zigma_t* handle);
+ZIGMA_API void zigma_print(zigma_t* handle);
 
 #endif // _ZIGMA_ZIGMA_H_